@@ -0,0 +1,65 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A bump pointer allocator for objects that all die together. Every phase
+ * of the compiler allocates what it makes from an arena of its own, which
+ * is freed in one go once the phases after it are done with it:
+ *
+ * - tokens: Lexer.token_arena, until DeleteLexer(), or until the next
+ *           statement when streaming, see ReleaseTokens()
+ * - AST:    Lexer.arena, until IR has been generated from it, or until the
+ *           next statement when streaming and only parsing
+ * - sema:   the symbols, also until IR has been generated
+ * - IR:     until it has been printed
+ *
+ * Nothing allocated from an arena is freed on its own. Memory is taken from
+ * the system in blocks of at least ARENA_BLOCK bytes, the blocks growing
+ * with the arena, or in 2MB huge pages with ARENA_HUGE */
+
+#define ARENA_BLOCK (64 * 1024)
+#define ARENA_BLOCK_MAX (1024 * 1024)
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+// Arena.flags:
+// ARENA_HUGE - blocks are 2MB aligned and the kernel is asked to back them
+// 				with transparent huge pages
+#define ARENA_HUGE (1 << 0)
+
+typedef struct ArenaBlock {
+	struct ArenaBlock* prev;
+	size_t size; // of the whole block, this header included
+} ArenaBlock;
+
+typedef struct Arena {
+	ArenaBlock* block; // the block being filled, which links to the others
+	char*    next;     // where the next allocation goes
+	char*    end;      // the end of the block being filled
+	size_t   used;     // bytes handed out
+	size_t   reserved; // bytes taken from the system
+	uint32_t flags;
+} Arena;
+
+void InitArena(Arena* arena, uint32_t flags);
+void DeleteArena(Arena* arena);
+
+// Hands the blocks of from, which must have the same flags, over to arena,
+// which frees them with its own. Allocations carry on in the block of arena
+void ArenaAdopt(Arena* arena, Arena* from);
+
+// Frees everything allocated from arena at once, but keeps the block it was
+// filling to allocate from again
+void ArenaReset(Arena* arena);
+
+// Returns size bytes aligned to 8, or NULL when out of memory
+void* ArenaAlloc(Arena* arena, size_t size);
+
+// The memory of an object with the lifetime of arena, or one for free() to
+// release when there is no arena
+static inline void* Allocate(Arena* arena, size_t size) {
+	return (arena) ? ArenaAlloc(arena, size) : malloc(size);
+}
+#endif
@@ -0,0 +1,13 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/* Micro-benchmarks for the hot parts of the compiler. These are selected 
+ * with the LANG_BENCH environment variable, see RunBenchmark() */
+int RunBenchmark(const char* which, const char* file);
+int BenchLexer(const char* file);
+int BenchParser(const char* file);
+int BenchIncremental(const char* file);
+int BenchMap(const char* file);
+int BenchIR(const char* file);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __EXPR_POOL_H__
+#define __EXPR_POOL_H__
+
+#include <stddef.h>
+#include "parser.h"
+
+/* Hash-consing of expressions. When Lexer.pool is set, the parser interns
+ * every node it finishes, so identical subtrees are one and the same node,
+ * shared by every statement they appear in. The operands of a node are
+ * interned before it, which makes two nodes identical when they have the
+ * same type, operator or literal, and the same operand pointers. The same 
+ * name can stand for different variables in different places, so the 
+ * parser only shares the subtrees without names in them. Sema shares the
+ * rest as it resolves them, where a name is identical to another when it
+ * stands for the same Symbol, see Expr.sym.
+ *
+ * Shared nodes have EXPR_SHARED set and belong to the pool: DeleteExpr()
+ * leaves them alone, and they are freed with it. They keep the location of
+ * their first occurrence in the file, and sema only checks them once, see 
+ * Expr.rtype, or reports their error at the node above them in every other
+ * occurrence. Neither the parser nor sema use threads while a pool is set */
+
+typedef struct ExprPool {
+	Expr**    slots;    // open addressing, NULL when empty
+	uint32_t* hashes;
+	uint32_t  capacity; // a power of 2
+	uint32_t  count;    // unique nodes
+	uint64_t  hits;     // nodes that were replaced by one already in the pool
+} ExprPool;
+
+void InitExprPool(ExprPool* pool);
+
+// Frees every node in the pool, as well as what sema hung under them
+void DeleteExprPool(ExprPool* pool);
+
+// Returns the node identical to expr, freeing expr, or adds expr to the pool.
+// A name sema has not resolved, a node above one, and anything without 
+// memory to grow the pool for are returned as they are, not shared
+Expr* InternExpr(ExprPool* pool, Expr* expr);
+
+// The memory in use by the nodes and the table
+size_t ExprPoolBytes(ExprPool* pool);
+#endif
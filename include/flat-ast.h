@@ -0,0 +1,52 @@
+#ifndef __FLAT_AST_H__
+#define __FLAT_AST_H__
+
+#include <stddef.h>
+#include "sema.h"
+
+/* Expressions laid out in post-order, as one array per field of a node, and
+ * linked by 32 bit node indices instead of pointers. Every operand comes
+ * before the node using it, and the nodes of one expression are contiguous
+ * and end with its root, so an expression is processed by a plain loop
+ * from its first node to its root:
+ *
+ * - ET_INT_LITERAL: FlatAst.args is an index into FlatAst.literals
+ * - ET_IDENT:       FlatAst.args is an index into FlatAst.idents and
+ *                   FlatAst.symbols
+ * - ET_UNARY_OP:    the operand is the node right before it
+ * - ET_BINARY_OP:   the right operand is the node right before it, and
+ *                   FlatAst.args is the index of the left operand
+ * - ET_CAST:        the operand is the node right before it, and
+ *                   FlatAst.args is an index into FlatAst.targets
+ */
+
+typedef struct FlatAst {
+	uint8_t*  kinds;       // enum ExprType
+	uint8_t*  ops;         // OperatorCode of unary and binary ops
+	uint32_t* offsets;     // Location.offset
+	uint32_t* args;
+	Type**    types;       // what sema resolved the nodes to, NULL if it
+	                       // has not been run
+	uint32_t  nnodes;
+	uint32_t  max_nodes;
+
+	IntLiteral* literals;
+	Name*     idents;
+	struct Symbol** symbols; // Expr.sym, NULL if sema has not been run
+	Type** targets;
+	uint32_t nliterals, max_literals;
+	uint32_t nidents, max_idents;
+	uint32_t ntargets, max_targets;
+} FlatAst;
+
+void InitFlatAst(FlatAst* ast);
+void DeleteFlatAst(FlatAst* ast);
+
+// Appends the nodes of expr and returns the index of its root, or UINT32_MAX
+// when out of memory. The first node is FlatAst.nnodes from before the call
+uint32_t FlattenExpr(FlatAst* ast, Expr* expr);
+
+// Prints the nodes [first, root] like DumpExpr() does
+void DumpFlatExpr(FlatAst* ast, uint32_t first, uint32_t root);
+size_t FlatAstBytes(FlatAst* ast);
+#endif
@@ -0,0 +1,54 @@
+#ifndef __INCREMENTAL_H__
+#define __INCREMENTAL_H__
+
+#include "lexer.h"
+#include "parser.h"
+
+/* A source file that is being edited, kept lexed and parsed between edits.
+ * An edit re-lexes only the lines it touches, and re-parses only the top
+ * level statements whose tokens changed, until the parser is back at the
+ * start of a statement it already has */
+
+typedef enum DocumentError {
+	DOC_SUCCESS,
+	DOC_INVALID_EDIT, // the edit lies outside of the text
+	DOC_OUT_OF_MEMORY,
+	DOC_UNKNOWN_TOKEN, // nothing is parsed until a later edit fixes it
+	DOC_PARSE_ERROR    // statements from the error on are missing
+} DocumentError;
+
+typedef struct Document {
+	Lexer lexer;      // over Document.text, Lexer.tokens is kept up to date
+	char* text;
+	uint32_t size;    // bytes of Document.text in use
+	uint32_t capacity;
+
+	Statement** stats; // the top level statements, in order, which are read
+	                   // through DocumentStatement()
+	uint32_t* starts;  // index of the first token of each statement
+	int32_t* moved;    // bytes that the locations of each statement are off
+	uint32_t nstats;
+	uint32_t max_stats;
+	uint32_t parsed;   // index of the token the statements end at, which is
+	                   // TT_EOF unless there was a parse error
+	int stale;         // the tokens are out of date after an unknown token
+} Document;
+
+// Statements [first, first + inserted) replaced the removed ones at first
+typedef struct DocumentChange {
+	uint32_t first;
+	uint32_t removed;
+	uint32_t inserted;
+} DocumentChange;
+
+// flags are added to Lexer.flags, such as LEXER_DFA and LEXER_QUIET
+DocumentError NewDocument(const char* name, const char* text, uint32_t size,
+		uint32_t flags, Document* doc);
+DocumentError EditDocument(Document* doc, uint32_t offset, uint32_t removed,
+		const char* text, uint32_t length, DocumentChange* change);
+void DeleteDocument(Document* doc);
+Statement* DocumentStatement(Document* doc, uint32_t index);
+
+// Checks a document against one parsed from scratch after random edits
+int CheckIncremental(const char* name);
+#endif
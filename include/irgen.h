@@ -10,54 +10,93 @@ enum IRInstruction {
 	IR_MAX
 };
 
-enum OperandType {
-	OP_IMM, OP_RESOURCE
-};
-
-typedef struct Operand {
-	enum OperandType type;
-	union {
-		int imm;
-		uint32_t resource;
-	};
-} Operand;
-
-typedef void* Instruction;
 typedef Type IRType;
 
+// A value is the index of the instruction that makes it in IR.insts
+typedef uint32_t IRValue;
+#define IR_NO_VALUE UINT32_MAX
+
+/* An instruction is a record of a fixed size, which names its operands by
+ * their values. Its type is a Type.tag, see TypeOfTag(), and the number of
+ * a constant is kept in IR.consts:
+ *
+ * - IR_CONST:        tID = const [type] <args[0] indexes IR.consts>
+ * - IR_NEG, IR_CAST: tID = {neg, cast} [type] <args[0]>
+ * - binary ops:      tID = {binary-op} [type] <args[0]>, <args[1]>
+ *
+ * The ID printed for an instruction is its value + 1 */
 typedef struct IRInst {
-	enum  IRInstruction code;
-	IRType* type;
-	Instruction operands;
+	uint8_t  code; // enum IRInstruction
+	uint8_t  type;
+	uint32_t args[2];
 } IRInst;
 
-// {binary-op} [type] <left>, <right>
-typedef struct IRBinaryOp {
-	IRInst*  left;
-	IRInst*  right;
-	uint32_t ID;
-} IRBinaryOp; 
-
-// tID = const [type] <target>
-typedef struct IRConstant {
-	int64_t  target;
-	uint32_t ID;
-} IRConstant; 
-
-// tID = neg [type] <target>
-typedef struct IRNegate {
-	IRInst* target;
-	uint32_t ID;
-} IRNegate;
-
-// tID = cast [type] <target>
-typedef struct IRCastType {
-	IRInst* target;
-	Type* type;
-	uint32_t ID;
-} IRCastType;
-
-Vector* GenIR(Vector* stats, Vector* symtab);
-void PrintIR(Vector* IR);
+/* The instructions in the order they run, in one array, so that a pass is a
+ * loop over it, and the instruction of a value is found by indexing it.
+ *
+ * Every value has a list of its uses, kept in arrays on the side as the
+ * instructions are added. A use is an operand of an instruction, numbered
+ * value * 2 + which operand it is, and IR.next_use links the uses of one
+ * value. ReplaceAllUsesWith() appends the list of a value to that of its
+ * replacement and leaves a link to it in IR.forward, which takes constant 
+ * time however many uses there are. The operands in the records are not 
+ * rewritten, so they are read through IRResolve(), and the records can be
+ * brought up to date in one pass with ResolveOperands(). An instruction 
+ * stays on the lists of its operands until IRRemoveUses() takes it off, 
+ * once nothing uses it any more */
+#define IR_NO_USE UINT32_MAX
+
+typedef struct IR {
+	IRInst*  insts;
+	uint64_t* consts;
+	uint32_t ninsts, max_insts;
+	uint32_t nconsts, max_consts;
+
+	// By value
+	uint32_t* first_use; // IR_NO_USE when it has none
+	uint32_t* last_use;
+	uint32_t* nuses;
+	IRValue*  forward;   // what it was replaced with, IR_NO_VALUE if not
+
+	// By use
+	uint32_t* next_use;
+} IR;
+
+void InitIR(IR* ir);
+void DeleteIR(IR* ir);
+
+static inline IRInst* IRInstOf(IR* ir, IRValue value) {
+	return &ir->insts[value];
+}
+
+// How many of the arguments of an instruction are values
+int IROperands(enum IRInstruction code);
+
+// The value that stands for value now it may have been replaced
+IRValue IRResolve(IR* ir, IRValue value);
+
+static inline IRValue IROperand(IR* ir, IRInst* inst, int operand) {
+	return IRResolve(ir, inst->args[operand]);
+}
+
+static inline IRInst* IRUser(IR* ir, uint32_t use) {
+	return &ir->insts[use / 2];
+}
+
+// Makes every use of value one of replacement, which must not use value
+void ReplaceAllUsesWith(IR* ir, IRValue value, IRValue replacement);
+
+// Takes the operands of a dead instruction off the lists of their values,
+// in time linear in the number of uses of those
+void IRRemoveUses(IR* ir, IRValue value);
+
+// Rewrites the operands of every instruction to what they resolve to
+void ResolveOperands(IR* ir);
+
+// Generates the IR of statements sema has resolved the names in, and 
+// appends it to ir. What it keeps about the variables is allocated from 
+// arena if it is not NULL. Returns 0 on an error
+int GenIR(IR* ir, Vector* stats, Arena* arena);
+void PrintIR(IR* ir);
 
 #endif
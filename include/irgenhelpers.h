@@ -3,13 +3,14 @@
 
 #include "irgen.h"
 
-IRInst* IRConst(Vector* IR, IRType* type, int64_t n); 
-IRInst* IRAdd(Vector* IR, IRInst* left, IRInst* right, IRType* type);
-IRInst* IRSub(Vector* IR, IRInst* left, IRInst* right, IRType* type);
-IRInst* IRMul(Vector* IR, IRInst* left, IRInst* right, IRType* type);
-IRInst* IRDiv(Vector* IR, IRInst* left, IRInst* right, IRType* type);
-IRInst* IRMod(Vector* IR, IRInst* left, IRInst* right, IRType* type); 
-IRInst* IRNeg(Vector* IR, IRInst* op, IRType* type);
-uint32_t* GetIDField(IRInst* inst);
-IRInst* IRCast(Vector* IR, IRInst* operand, IRType* type); 
+// The instructions are appended to ir, and return their value, or 
+// IR_NO_VALUE when out of memory
+IRValue IRConst(IR* ir, IRType* type, uint64_t n); 
+IRValue IRAdd(IR* ir, IRValue left, IRValue right, IRType* type);
+IRValue IRSub(IR* ir, IRValue left, IRValue right, IRType* type);
+IRValue IRMul(IR* ir, IRValue left, IRValue right, IRType* type);
+IRValue IRDiv(IR* ir, IRValue left, IRValue right, IRType* type);
+IRValue IRMod(IR* ir, IRValue left, IRValue right, IRType* type); 
+IRValue IRNeg(IR* ir, IRValue op, IRType* type);
+IRValue IRCast(IR* ir, IRValue operand, IRType* type); 
 #endif
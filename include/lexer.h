@@ -2,7 +2,11 @@
 #define __LEXER_H__
 
 #include <stdint.h>
+#include <setjmp.h>
 #include "vector.h"
+#include "arena.h"
+
+struct ExprPool;
 
 typedef enum LexerError {
 	SUCCESS,
@@ -14,55 +18,127 @@ typedef enum LexerError {
 	FILE_TOO_LONG,
 	FILE_MAP_FAILED,
 	EMPTY_FILE,
-	RESOURCE_CLEANUP_FAILED
+	RESOURCE_CLEANUP_FAILED,
+	CHUNK_FAILED, // a chunk lexed in parallel has to be lexed again in order
+	STREAM_NOT_SUPPORTED // LexAll() on a lexer from NewStreamLexer()
 } LexerError;
 
 /*  Represents the current state of the lexer 
  *  This lexer is designed to work with source files < 4GB, by design
  *  because generally, source files should not even approach this size by a
- *  wide margin. Furthermore, NewLexer will reject files that are greater 
- *  than 1MB in size, because most source files will rarely ever exceed
- *  this size. Moreover since the lexer relies on mapping files to memory, 
- *  we cannot have too many huge files in memory at any time */
+ *  wide margin, and offsets into the source fit in 32 bits.
+ *  NewLexer maps regular files into memory. Pipes, stdin ("-") and anything
+ *  opened through NewStreamLexer are instead read through a window of 
+ *  LEXER_WINDOW bytes that slides forward as tokens are consumed, so the 
+ *  source takes the same memory whatever the size of the input, and so do 
+ *  the tokens, see ReleaseTokens(). Only the text of the tokens after 
+ *  Lexer.keep is available then, see TokenText() */
 
 typedef enum TokenType {
-	TT_EOF,
-	TT_NUMBER,
-	TT_PLUS, TT_MINUS, TT_ASTERISK, TT_SLASH, TT_SEMICOLON,
-	TT_LET, TT_IDENT, TT_EQUALS, TT_COLON, TT_PERCENT,
-	TT_LPAREN, TT_RPAREN, TT_COMMA, TT_FUNCTION, TT_RETURNS, 
-	TT_LCURLY, TT_RCURLY, TT_MAX
+#define TOKEN(type, desc) type,
+#include "tokens.def"
+	TT_MAX
 } TokenType;
 
+/* Tokens don't carry their line and column, those are only needed to 
+ * report errors and can be recovered from the offset, see LexerLocate().
+ * The type and the length share a word, so that the hash of identifiers 
+ * fits in 12 bytes along with them */
 typedef struct Token {
-	enum TokenType type;
-	uint32_t line;
-	uint32_t pos;
 	uint32_t offset;
-	uint32_t length;
+	uint32_t length : 24;     // at most TOKEN_MAX_LENGTH
+	enum TokenType type : 8;
+	uint32_t hash; // HashName() of an identifier, 0 for other tokens
 } Token; 
 
+#define TOKEN_MAX_LENGTH ((1u << 24) - 1)
+
 typedef struct Lexer {
-	char*    source; // the code from the file - mapped into memory
+	char*    source; // the code from the file - mapped into memory, or the 
+	                 // window over it when streaming
 	char*    file;   // the name of the file that the lexer is working on
 	Token*   peek;   // the next token filled in by a call to Peek()
-	Vector*  extent; // a vector of LineExtents
+	Token*   tokens; // every token of the file, filled in by LexAll()
+	uint32_t* lines; // offsets where each line begins, see LexerLocate()
 	uint32_t offset; // offset into Lexer.source we are currently at
 	uint32_t size;   // the size of the file we are working on, in bytes
-	uint32_t line;   // the line we are at in the code (lines end with '\n')
-	uint32_t pos;    // the position we are at, within the line
+	uint32_t nlines; // number of lines in Lexer.lines, 0 until it is built
 	uint32_t flags;  // Additional flags of the lexer state
+	uint32_t ntokens; // number of tokens in Lexer.tokens
+	uint32_t cursor;  // index into Lexer.tokens of the token Next() returns
+
+	// Only used when streaming, where Lexer.offset and Lexer.size are 
+	// relative to the window, and Token.offset is relative to the file
+	uint32_t base;      // offset in the file of Lexer.source[0]
+	uint32_t base_line; // number of lines before the window
+	uint32_t keep;      // offset in the file of the first byte that has to 
+	                    // stay in the window, set by whoever reads tokens
+	uint32_t filled;    // bytes read into the window, past Lexer.size
+	uint32_t npast;     // number of lines in Lexer.past
+	uint32_t* past;     // offsets in the file where each line that has left
+	                    // the window begins, 4 bytes a line
+	char*    past_text; // the last line LexerLocate() read back for them
+	uint32_t capacity;  // size of the window buffer
+	int      fd;        // what we are reading from
+
+	uint32_t threads;   // threads LexAll() may use, 0 picks one per core
+	jmp_buf* bail;      // where a chunk lexer goes on an unknown token
+	struct ExprPool* pool; // the parser and sema hash-cons expressions into it
+	Arena*   arena;     // the parser allocates the AST from it if set
+	Arena    token_arena; // what Next() returns when not in batch mode
 } Lexer;
 
+#define LEXER_WINDOW (1 << 20)
+
+// Lexer.flags:
+// LEXER_BATCH - the whole file has been lexed into Lexer.tokens, and Next()
+// 				 and Peek() only move a cursor over it
+// LEXER_DFA   - scan tokens with the table driven lexer in lexer-dfa.c
+// 				 instead of the hand written one
+// LEXER_STREAM - the source is read through a window, see NewStreamLexer()
+// LEXER_BUFFER - the source belongs to the caller, see NewBufferLexer()
+// LEXER_QUIET  - the parser does not print its errors
+// LEXER_VALID  - the source has been checked to be UTF-8
+// LEXER_LAZY   - the parser skips over function bodies in batch mode, and
+// 				 leaves them to FunctionBody()
+#define LEXER_BATCH  (1 << 0)
+#define LEXER_DFA    (1 << 1)
+#define LEXER_STREAM (1 << 2)
+#define LEXER_BUFFER (1 << 3)
+#define LEXER_QUIET  (1 << 4)
+#define LEXER_VALID  (1 << 5)
+#define LEXER_LAZY   (1 << 6)
+
 LexerError NewLexer(const char* name, Lexer* lexer);
+LexerError NewStreamLexer(const char* name, Lexer* lexer);
+LexerError NewBufferLexer(const char* name, char* text, uint32_t size, 
+		Lexer* lexer);
+LexerError LexAll(Lexer* lexer);
+int CompareLexers(const char* name);
 Token* Next(Lexer* lexer);
 Token* Peek(Lexer* lexer);
+
+// Frees the tokens Next() has handed out when not in batch mode, except for
+// the one Peek() has ready. Called once nothing points to them any more
+void ReleaseTokens(Lexer* lexer);
 void DumpToken(Lexer* lexer, Token* token); 
 LexerError DeleteLexer(Lexer* lexer);
 
-typedef struct LineExtent {
-	uint32_t line;
-	uint32_t offset;
-	uint32_t length;
-} LineExtent;
+// Where an offset into the source lies, lines end with '\n'
+typedef struct LineInfo {
+	uint32_t line;   // 1-based line number
+	uint32_t pos;    // 1-based column, assuming tab stops of 8 spaces
+	uint32_t length; // length of the line, without the '\n'
+	const char* text; // where the line begins
+} LineInfo;
+
+// For an offset that a streaming lexer has already moved past, LexerLocate
+// reads the line back from the file. When the input can't be read again (a
+// pipe), it returns a LineInfo without text, where pos counts bytes
+LineInfo LexerLocate(Lexer* lexer, uint32_t offset);
+
+// The text of a token, which must still be in the window when streaming
+static inline const char* TokenText(Lexer* lexer, Token* token) {
+	return lexer->source + (token->offset - lexer->base);
+}
 #endif
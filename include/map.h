@@ -0,0 +1,75 @@
+#ifndef __MAP_H__
+#define __MAP_H__
+
+#include <stdint.h>
+
+/* A hash map from void* keys to void* values, laid out like a Swiss table:
+ * every slot has a control byte, which is MAP_EMPTY or the top 7 bits of
+ * the hash of its key, and a lookup compares a whole group of MAP_GROUP
+ * control bytes against those bits at once with SSE2, so the keys are only
+ * compared where the bits match.
+ *
+ * A key lives at the slot its hash picks, or in the first free one after
+ * it, so when a key is removed, the keys after it are moved back into the
+ * hole instead of leaving a tombstone behind, and a lookup can stop at the
+ * first empty slot however many keys have been removed.
+ *
+ * The hashes are kept next to the keys, so growing never calls the hash
+ * function again. Keys and values belong to the caller */
+
+// The hash of a key, which the map mixes further, so it need not be strong
+typedef uint32_t (*HashContents) (void* data);
+
+// 0 when both keys are the same, like strcmp()
+typedef int (*Compare) (void* e1, void* e2);
+
+#define MAP_GROUP 16
+#define MAP_EMPTY 0x80
+
+typedef struct MapEntry {
+	void* key;
+	void* value;
+} MapEntry;
+
+typedef struct Map {
+	uint8_t*  ctrl;     // capacity control bytes, and the first group again
+	uint32_t* hashes;
+	MapEntry* entries;
+	uint32_t  capacity; // 0 or a power of 2, at least MAP_GROUP
+	uint32_t  size;
+	HashContents hasher;
+	Compare   compare;
+} Map;
+
+Map* NewMap(HashContents hasher, Compare compare);
+void DeleteMap(Map* map);
+uint32_t MapLength(Map* map);
+
+// Makes room for count keys in all, so that adding them does not grow the
+// map. Returns 0 when out of memory
+int MapReserve(Map* map, uint32_t count);
+
+// The entry of key, or NULL
+MapEntry* MapFind(Map* map, void* key);
+void* MapGet(Map* map, void* key); // NULL for a key not in the map
+
+// Sets the value of key, adding it if it is not in the map yet. Returns 0
+// when out of memory
+int MapInsert(Map* map, void* key, void* value);
+
+// Returns 0 if key was not in the map
+int MapRemove(Map* map, void* key);
+
+/* The same, with the hash of key worked out by the caller already, which
+ * has to be what the hash function of the map returns for it. Inserting
+ * returns the entry of key, which only gets value if key was not in the map
+ * yet, or NULL when out of memory. An entry is valid until the map changes */
+MapEntry* MapFindHashed(Map* map, void* key, uint32_t hash);
+MapEntry* MapInsertHashed(Map* map, void* key, uint32_t hash, void* value);
+
+// Hash functions and comparisons for NUL terminated strings and pointers
+uint32_t HashString(void* data);
+int CompareStrings(void* e1, void* e2);
+uint32_t HashPointer(void* data);
+int ComparePointers(void* e1, void* e2);
+#endif
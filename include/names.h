@@ -0,0 +1,36 @@
+#ifndef __NAMES_H__
+#define __NAMES_H__
+
+#include <stdint.h>
+
+/* Every distinct identifier is stored once, and stands for a 32 bit Name
+ * everywhere else, so two names are the same when their numbers are, and
+ * the memory they take does not grow with how often they are used.
+ *
+ * The names are shared by the whole program, so that names from different
+ * lexers, or from threads parsing in parallel, can be compared too. They
+ * are only freed when the program exits. NameText() takes no lock, a Name
+ * is only ever handed out once its text is in place, and InternName() only
+ * takes one for a name the thread has not interned lately */
+
+typedef uint32_t Name; // 0 is no name
+
+// FNV-1a, the lexer works it out for every identifier, see Token.hash
+static inline uint32_t HashName(const char* text, uint32_t length) {
+	uint32_t hash = 2166136261u;
+	for (uint32_t i = 0; i < length; i++)
+		hash = (hash ^ (uint8_t) text[i]) * 16777619u;
+
+	return hash;
+}
+
+// The Name of the length bytes at text, whose hash is HashName() of them.
+// Returns 0 when out of memory
+Name InternName(const char* text, uint32_t length, uint32_t hash);
+Name InternString(const char* text);
+
+// The text of a name, NUL terminated
+const char* NameText(Name name);
+uint32_t NameCount();
+
+#endif
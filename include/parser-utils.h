@@ -8,8 +8,11 @@ int IsOperator(TokenType type);
 int IsPrefixOperator(TokenType type);
 OperatorCode OpToUnop(TokenType type);
 OperatorCode OpToBinop(TokenType type);
-Expr* makeExpr(enum ExprType type);
+Expr* makeExpr(Arena* arena, enum ExprType type);
+void DeleteExprNode(Expr* expr);
 void ParserError(Lexer* lexer, Token* token, const char* msg);
 int Expect(Lexer* lexer, TokenType type, const char* msg);
-int ToDecimal(int digit, int base); 
+
+// Value of a digit character, which is only a digit in bases larger than it
+extern const uint8_t DIGIT_VALUES[256];
 #endif
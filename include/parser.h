@@ -2,15 +2,17 @@
 #define __PARSER_H__
 
 #include "lexer.h"
+#include "names.h"
 #include "operators.h"
 #include "types.h"
 
+// Line and column are worked out from the offset when reporting an error
 typedef struct Location {
-	uint32_t line;
-	uint32_t pos;
+	uint32_t offset;
 } Location;
 
 struct Expr;
+struct Symbol;
 typedef struct BinaryOp {
 	OperatorCode type;
 	struct Expr* left;
@@ -34,7 +36,7 @@ enum ExprType {
 
 typedef struct IntLiteral {
 	Type* type;
-	int64_t  number;
+	uint64_t number; // the bits of the value, negative only if type is signed
 } IntLiteral;
 
 typedef struct Cast {
@@ -44,16 +46,31 @@ typedef struct Cast {
 
 typedef struct Expr {
 	enum ExprType type;
+	uint32_t flags;
 	union {
 		IntLiteral* literal;
-		char* ident;
+		Name ident;
 		UnaryOp* unop;
 		BinaryOp* binop;
 		Cast* cast;
 	};
 	Location loc;
+	union {
+		Type* rtype;        // what sema resolved the node to, NULL until
+		                    // then or if it has an error
+		struct Symbol* sym; // the variable an ET_IDENT names, whose type
+		                    // is that of the node, set by sema
+	};
 } Expr;
 
+// Expr.flags, a node with either one is not freed by DeleteExpr():
+// EXPR_SHARED - interned in an ExprPool, which owns it, see expr-pool.h
+// EXPR_ARENA  - allocated from an arena, along with what it points to
+// EXPR_TYPED  - a shared node sema has resolved the type of already
+#define EXPR_SHARED (1 << 0)
+#define EXPR_ARENA  (1 << 1)
+#define EXPR_TYPED  (1 << 2)
+
 enum StatementType {
 	ST_EXPR,
 	ST_VARDECL,
@@ -61,23 +78,28 @@ enum StatementType {
 };
 
 typedef struct VarDecl {
-	const char* ident;
-	const char* type;
+	Name   ident;
+	Name   type; // 0 when it is left to the initializer
 	Expr*  init;
 	Location loc;
 	Location loc_type;
+	struct Symbol* sym; // the variable declared, set by sema
 } VarDecl;
 
 typedef struct FuncArgs {
-	const char* type;
-	const char* name;
+	Name type;
+	Name name;
 } FuncArgs;
 
 typedef struct Function {
-	const char* name;
-	const char* rtype;
+	Name name;
+	Name rtype; // 0 without a return type
 	Vector* args;
-	Vector* statements;
+	Vector* statements; // NULL while a lazily parsed body is still skipped
+	uint32_t body;      // index of the first token after '{'
+	uint32_t body_end;  // index of the '}'
+	Location open;      // the braces around the body
+	Location close;
 } Function;
 
 typedef struct Statement {
@@ -91,7 +113,45 @@ typedef struct Statement {
 	Location loc;
 } Statement;
 
+/* Walks an expression in post-order on a stack of its own instead of the C
+ * stack, so that every operand comes out of NextExpr() before the node that
+ * uses it. NextExpr() returns NULL at the end, or when it ran out of memory,
+ * in which case ExprWalk.failed is set */
+typedef struct ExprVisit {
+	Expr* expr;
+	int expanded; // the operands of expr have been pushed
+} ExprVisit;
+
+#define EXPR_WALK_INLINE 32
+DEFINE_VECTOR(ExprVisitStack, ExprVisit, EXPR_WALK_INLINE)
+
+typedef struct ExprWalk {
+	ExprVisitStack stack;
+	int failed;
+	uint32_t leaves; // nodes with any of these Expr.flags come out without
+	                 // their operands, 0 unless set after BeginExprWalk()
+} ExprWalk;
+
+void BeginExprWalk(ExprWalk* walk, Expr* root);
+Expr* NextExpr(ExprWalk* walk);
+void EndExprWalk(ExprWalk* walk);
+
 Statement* ParseStatement(Lexer* lexer);
+
+// The statements of a function, parsed now if LEXER_LAZY skipped them. The
+// lexer has to be the one the function was parsed with. Returns NULL and
+// reports the error when the body fails to parse
+Vector* FunctionBody(Lexer* lexer, Function* func);
+
+/* Parses the statements from Lexer.cursor on with one thread per core, or
+ * threads if that is not 0, and appends them to stats. It stops before the
+ * first statement with an error, where Lexer.cursor is left for the caller
+ * to parse it and report the error. Returns the number of statements */
+uint32_t ParseParallel(Lexer* lexer, Vector* stats, uint32_t threads);
 void DumpExpr(Expr* expr); 
 void DumpStatement(Statement* stat); 
+void DeleteExpr(Expr* expr);
+
+// Statements parsed with Lexer.arena belong to it, and are not deleted
+void DeleteStatement(Statement* stat);
 #endif
@@ -0,0 +1,82 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stdint.h>
+
+/* Character classification and run scanning for the lexer. 
+ * The classification is plain ASCII and does not depend on the locale, 
+ * unlike <ctype.h>. The Scan*() functions classify 16 or 32 bytes at a 
+ * time with SSE2/AVX2 where the CPU supports it, and fall back to a scalar
+ * loop everywhere else. The implementation is picked by InitScanner().
+ * Bytes outside of ASCII belong to no class, the lexer decodes those */
+
+#define CC_DIGIT (1 << 0) // 0-9
+#define CC_ALPHA (1 << 1) // a-z, A-Z
+#define CC_SPACE (1 << 2) // ' ', '\t', '\n', '\v', '\f', '\r'
+
+extern const uint8_t CHAR_CLASS[256];
+
+#define IsDigit(c) (CHAR_CLASS[(uint8_t)(c)] & CC_DIGIT)
+#define IsAlpha(c) (CHAR_CLASS[(uint8_t)(c)] & CC_ALPHA)
+#define IsAlnum(c) (CHAR_CLASS[(uint8_t)(c)] & (CC_ALPHA | CC_DIGIT))
+#define IsSpace(c) (CHAR_CLASS[(uint8_t)(c)] & CC_SPACE)
+#define IsHigh(c)  ((uint8_t)(c) >= 0x80)
+
+#define CC_IN_RUN(c, cls) (CHAR_CLASS[(uint8_t)(c)] & (cls))
+
+typedef uint32_t (*Scanner) (const char* source, uint32_t offset, 
+		uint32_t size);
+
+// The vector kernels picked by InitScanner()
+extern Scanner scan_alnum;
+extern Scanner scan_space;
+extern Scanner scan_line;
+extern Scanner scan_utf8;
+
+void InitScanner();
+
+/* Most identifiers, numbers and runs of whitespace are only a handful of bytes 
+ * long, and for those a few scalar steps are cheaper than setting up a 
+ * vector compare. So the first SCAN_SHORT_RUN bytes are checked inline and 
+ * only longer runs are handed to the vector kernels */
+#define SCAN_SHORT_RUN 8
+
+static inline uint32_t ScanRun(const char* source, uint32_t offset, 
+		uint32_t size, int cls, Scanner kernel) {
+	uint32_t end = (size - offset > SCAN_SHORT_RUN) 
+		? offset + SCAN_SHORT_RUN : size;
+
+	for (; offset < end; offset++) {
+		if (!CC_IN_RUN(source[offset], cls))
+			return offset;
+	}
+
+	return (offset < size) ? kernel(source, offset, size) : offset;
+}
+
+// All of these return the offset of the first byte in 
+// source[offset, size) that does not belong to the run, or size if 
+// the run extends to the end of source
+static inline uint32_t ScanAlnum(const char* source, uint32_t offset, 
+		uint32_t size) {
+	return ScanRun(source, offset, size, CC_ALPHA | CC_DIGIT, scan_alnum);
+}
+
+static inline uint32_t ScanSpace(const char* source, uint32_t offset, 
+		uint32_t size) {
+	return ScanRun(source, offset, size, CC_SPACE, scan_space);
+}
+
+// Comments are usually long, so these always go to the vector kernel
+static inline uint32_t ScanLine(const char* source, uint32_t offset, 
+		uint32_t size) {
+	return scan_line(source, offset, size);
+}
+
+// The first byte that is not part of valid UTF-8, checked with SSSE3/AVX2
+static inline uint32_t ScanUTF8(const char* source, uint32_t offset, 
+		uint32_t size) {
+	return scan_utf8(source, offset, size);
+}
+
+#endif
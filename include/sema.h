@@ -2,23 +2,27 @@
 #define __SEMA_H__
 
 #include "parser.h"
+#include "symtab.h"
 #include "types.h"
 
-enum SymbolType {
-	TYPE_VARIABLE, // A variable declaration
-	TYPE_TYPEDEF,  // A definition for a  type, user-defined or built-in
-};
+/* Checks the statements, and resolves every name in them to its symbol and
+ * every expression to its type on the way, see Expr.rtype, Expr.sym and 
+ * VarDecl.sym. Returns the table of the symbols at the top level, or NULL if
+ * there was an error. The symbols, and the casts put into the expressions,
+ * are allocated from arena if it is not NULL.
+ *
+ * The bodies of the functions are checked with one thread per core, or 
+ * threads if that is not 0. The errors are printed in source order all the
+ * same */
+SymbolTable* SemanticAnalyse(Lexer* lexer, Vector* statements, Arena* arena,
+		uint32_t threads);
 
-typedef struct Symbol {
-	const char* name;
-	enum SymbolType type;
-	uint32_t flags;
-	Type* utype;
-	void* data;
-} Symbol;
+// The type sema resolved an expression to, NULL before sema or on an error
+static inline Type* TypeOfExpr(Expr* expr) {
+	if (expr->type != ET_IDENT)
+		return expr->rtype;
 
-Vector* SemanticAnalyse(Lexer* lexer, Vector* statements);
-Type* GetType(Vector* symtab, const char* name);
-Symbol* GetVariable(Vector* symtab, const char* name);
+	return (expr->sym) ? expr->sym->utype : NULL;
+}
 
 #endif
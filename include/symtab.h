@@ -0,0 +1,83 @@
+#ifndef __SYMTAB_H__
+#define __SYMTAB_H__
+
+#include "arena.h"
+#include "map.h"
+#include "names.h"
+#include "types.h"
+#include "vector.h"
+
+enum SymbolType {
+	TYPE_VARIABLE, // A variable declaration
+	TYPE_TYPEDEF,  // A definition for a  type, user-defined or built-in
+	SYMBOL_TYPES
+};
+
+typedef struct Symbol {
+	Name name;
+	enum SymbolType type;
+	uint32_t flags;
+	uint32_t order; // of the declaration in its table, see SymbolTable.symbols
+	Type* utype;
+	void* data;
+	struct Symbol* shadowed;  // the symbol of the same name this one hides
+	struct Symbol* shadowing; // the one that hides it outside of any scope
+} Symbol;
+
+/* The symbols in scope, found by name through one Map per kind of symbol,
+ * which holds the innermost symbol of every name. Declaring a name that is
+ * in scope already shadows it, and popping a scope puts back what its
+ * symbols shadowed, so both take constant time, as does a lookup.
+ *
+ * Symbols outlive their scope: the AST keeps handles to them once sema has
+ * resolved it, see Expr.sym and VarDecl.sym. They are freed along with the
+ * table, or with its arena if it has one.
+ *
+ * An inner table has scopes of its own inside of an outer one, whose names
+ * it finds when it has none of them. It only sees the symbols declared in
+ * the outer table before a point, and the outer table is only read, so
+ * inner tables on several threads can share one that no longer changes.
+ * Where a lookup stopped on the chain of symbols of a name in the outer 
+ * table is remembered, and the next one starts from there, so moving the 
+ * point forward walks every chain once in all */
+
+DEFINE_VECTOR(ScopeMarks, uint32_t, 16)
+
+typedef struct SymbolTable {
+	Map*       names[SYMBOL_TYPES];
+	Vector*    symbols; // every symbol declared, in order
+	Vector*    scoped;  // the symbols declared in the open scopes
+	ScopeMarks scopes;  // where each open scope starts in scoped
+	Arena*     arena;
+	struct SymbolTable* outer; // NULL unless an inner table
+	uint32_t   visible; // how many of the symbols of outer are seen
+	Map*       found[SYMBOL_TYPES]; // name -> where its lookup in outer was
+} SymbolTable;
+
+// The symbols are allocated from arena if it is not NULL
+SymbolTable* NewSymbolTable(Arena* arena);
+void DeleteSymbolTable(SymbolTable* table);
+
+// A table inside of outer, which sees the first visible symbols of outer,
+// see SymbolTable.visible, which can be changed once no scope is open
+SymbolTable* NewInnerTable(SymbolTable* outer, uint32_t visible, 
+		Arena* arena);
+
+// Hands the symbols of from over to table, which frees them with its own
+// when it has no arena. Returns 0 when out of memory
+int AdoptSymbols(SymbolTable* table, SymbolTable* from);
+
+// Returns 0 when out of memory
+int PushScope(SymbolTable* table);
+void PopScope(SymbolTable* table);
+
+// Adds a symbol for name to the innermost scope, or returns NULL when out of
+// memory
+Symbol* Declare(SymbolTable* table, Name name, enum SymbolType type,
+		uint32_t flags);
+
+// The innermost symbol of that kind with that name, or NULL. Only reads
+// the outer table of an inner one
+Symbol* Lookup(SymbolTable* table, Name name, enum SymbolType type);
+
+#endif
@@ -4,14 +4,27 @@
 #include <stdint.h>
 #include "operators.h"
 
+/* Every type has a tag of its own, which indexes the registry of types, see
+ * TypeOfTag(). What a type supports is kept in it as bitsets, so that sema
+ * checks an operator or a conversion with a single bit test */
 typedef struct Type {
 	const char* name;
 	int 		tag;
 	int 		size;
 	int 		align;
+	uint32_t	ops;      // OP_BIT() of every operator the type supports
+	uint64_t	converts; // TAG_BIT() of every type it converts to implicitly
 	void* 		data;
 } Type;
 
+#define TYPE_TAGS_MAX 64
+
+#define OP_BIT(code) (1u << (code))
+#define TAG_BIT(tag) ((uint64_t) 1 << (tag))
+
+// The operators [first, end), of one arity
+#define OP_RANGE(first, end) (OP_BIT(end) - OP_BIT(first))
+
 extern const int BUILTIN_TAGS_MAX;
 
 Type* I8();
@@ -26,7 +39,24 @@ Type* U64();
 
 extern Type* BUILTIN_TYPES[];
 extern const int len_builtins;
-int TypeSupportsOp(Type* type, OperatorCode code);
-int TypesCompatible(Type* t1, Type* t2);
+
+// Gives a type defined by the program the next free tag, returns 0 when
+// there is none left. Not thread safe
+int RegisterType(Type* type);
+Type* TypeOfTag(int tag); // NULL for a tag no type has
+void AllowConversion(Type* from, Type* to);
+
+static inline int TypeSupportsOp(Type* type, OperatorCode code) {
+	return (type->ops >> code) & 1;
+}
+
+// Whether t1 converts to t2 implicitly
+static inline int TypesCompatible(Type* t1, Type* t2) {
+	return (t1->converts >> t2->tag) & 1;
+}
+
+int TypeIsUnsigned(Type* type);
+int TypeFitsLiteral(Type* type, uint64_t value, int negated);
+void PrintLiteral(Type* type, uint64_t value);
 
 #endif
@@ -1,8 +1,13 @@
 #ifndef __VECTOR_H__
 #define __VECTOR_H__
 
+#include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
+// A vector of pointers, which doubles in capacity as it grows and only
+// allocates once something is appended to it
 typedef struct Vector {
 	void** data;
 	uint32_t capacity;
@@ -12,11 +17,75 @@ typedef struct Vector {
 Vector*  NewVector();
 Vector*  VectorOfLength(uint32_t size);
 uint32_t VectorLength(Vector* vec);
-void     Append(Vector* vec, const void* data);
+int      Append(Vector* vec, const void* data); // 0 when out of memory
 void*    Get(Vector* vec, uint32_t index);
 void     DeleteVector(Vector* vec);
 void*    Pop(Vector* vec);
 
 #define INVALID_INDEX ((void*)-1)
 
+/* Vectors of values of one type, stored in the vector itself rather than
+ * behind pointers. DEFINE_VECTOR(Name, T, N) defines the type Name, which
+ * has room for N values inside of it before they move to the heap, and:
+ *
+ *   void Init<Name>(Name* vec);
+ *   void Delete<Name>(Name* vec);
+ *   T*   Push<Name>(Name* vec);            room for a value at the end, or
+ *                                          NULL when out of memory
+ *   int  Append<Name>(Name* vec, T value); 0 when out of memory
+ *   T    Pop<Name>(Name* vec);
+ *   T*   <Name>At(Name* vec, uint32_t index);
+ *
+ * The capacity doubles as it grows. Indices are only checked by assert(),
+ * so not with NDEBUG. A vector whose values are inside of it points to
+ * itself, so it must not be copied */
+
+// Doubles the capacity of the values at *data, moving them off local
+int GrowVector(void** data, void* local, size_t size, uint32_t* capacity);
+
+#define DEFINE_VECTOR(Name, T, N)                                          \
+	typedef struct Name {                                                  \
+		T* data;                                                           \
+		uint32_t size;                                                     \
+		uint32_t capacity;                                                 \
+		T local[N];                                                        \
+	} Name;                                                                \
+	                                                                       \
+	static inline void Init##Name(Name* vec) {                             \
+		vec->data = vec->local;                                            \
+		vec->size = 0;                                                     \
+		vec->capacity = N;                                                 \
+	}                                                                      \
+	                                                                       \
+	static inline void Delete##Name(Name* vec) {                           \
+		if (vec->data != vec->local)                                       \
+			free(vec->data);                                               \
+		Init##Name(vec);                                                   \
+	}                                                                      \
+	                                                                       \
+	static inline T* Push##Name(Name* vec) {                               \
+		if (vec->size == vec->capacity && !GrowVector((void**) &vec->data, \
+					vec->local, sizeof(T), &vec->capacity))                \
+			return NULL;                                                   \
+		return &vec->data[vec->size++];                                    \
+	}                                                                      \
+	                                                                       \
+	static inline int Append##Name(Name* vec, T value) {                   \
+		T* slot = Push##Name(vec);                                         \
+		if (!slot)                                                         \
+			return 0;                                                      \
+		*slot = value;                                                     \
+		return 1;                                                          \
+	}                                                                      \
+	                                                                       \
+	static inline T Pop##Name(Name* vec) {                                 \
+		assert(vec->size);                                                 \
+		return vec->data[--vec->size];                                     \
+	}                                                                      \
+	                                                                       \
+	static inline T* Name##At(Name* vec, uint32_t index) {                 \
+		assert(index < vec->size);                                         \
+		return &vec->data[index];                                          \
+	}
+
 #endif
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+void InitArena(Arena* arena, uint32_t flags) {
+	memset(arena, 0, sizeof(Arena));
+	arena->flags = flags;
+}
+
+static void FreeBlock(ArenaBlock* block, uint32_t flags) {
+	if (flags & ARENA_HUGE)
+		munmap(block, block->size);
+	else
+		free(block);
+}
+
+void DeleteArena(Arena* arena) {
+	ArenaBlock* block = arena->block;
+	while (block) {
+		ArenaBlock* prev = block->prev;
+		FreeBlock(block, arena->flags);
+		block = prev;
+	}
+
+	InitArena(arena, arena->flags);
+}
+
+void ArenaReset(Arena* arena) {
+	ArenaBlock* block = arena->block;
+	if (!block)
+		return;
+
+	while (block->prev) {
+		ArenaBlock* prev = block->prev->prev;
+		FreeBlock(block->prev, arena->flags);
+		block->prev = prev;
+	}
+
+	arena->next = (char*) (block + 1);
+	arena->used = 0;
+	arena->reserved = block->size;
+}
+
+void ArenaAdopt(Arena* arena, Arena* from) {
+	if (!from->block)
+		return;
+
+	if (!arena->block) {
+		*arena = *from;
+		InitArena(from, from->flags);
+		return;
+	}
+
+	// The blocks of from go in right behind the one being filled
+	ArenaBlock* oldest = from->block;
+	while (oldest->prev)
+		oldest = oldest->prev;
+
+	oldest->prev = arena->block->prev;
+	arena->block->prev = from->block;
+	arena->used += from->used;
+	arena->reserved += from->reserved;
+	InitArena(from, from->flags);
+}
+
+/* Maps size bytes, a multiple of ARENA_HUGE_PAGE, at an address aligned to
+ * it, as a huge page can only back an aligned range. More than needed is
+ * mapped and the ends cut off */
+static void* MapHuge(size_t size) {
+	size_t mapped = size + ARENA_HUGE_PAGE;
+	char* start = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (start == MAP_FAILED)
+		return NULL;
+
+	uintptr_t aligned = ((uintptr_t) start + ARENA_HUGE_PAGE - 1) &
+		~(uintptr_t) (ARENA_HUGE_PAGE - 1);
+	char* block = (char*) aligned;
+	if (block != start)
+		munmap(start, block - start);
+
+	if (start + mapped != block + size)
+		munmap(block + size, start + mapped - (block + size));
+
+#ifdef MADV_HUGEPAGE
+	madvise(block, size, MADV_HUGEPAGE); // only a hint
+#endif
+	return block;
+}
+
+static int NewBlock(Arena* arena, size_t size) {
+	// Blocks double up to ARENA_BLOCK_MAX, so that small arenas stay small
+	size_t block_size = (arena->block) ? arena->block->size * 2 : ARENA_BLOCK;
+	if (block_size > ARENA_BLOCK_MAX)
+		block_size = ARENA_BLOCK_MAX;
+
+	size_t needed = size + sizeof(ArenaBlock);
+	if (block_size < needed)
+		block_size = needed;
+
+	ArenaBlock* block = NULL;
+	if (arena->flags & ARENA_HUGE) {
+		block_size = (block_size + ARENA_HUGE_PAGE - 1) &
+			~(size_t) (ARENA_HUGE_PAGE - 1);
+		block = MapHuge(block_size);
+	}
+	else
+		block = malloc(block_size);
+
+	if (!block)
+		return 0;
+
+	block->prev = arena->block;
+	block->size = block_size;
+	arena->block = block;
+	arena->next = (char*) (block + 1);
+	arena->end = (char*) block + block_size;
+	arena->reserved += block_size;
+	return 1;
+}
+
+void* ArenaAlloc(Arena* arena, size_t size) {
+	size = (size + 7) & ~(size_t) 7;
+	if ((size_t) (arena->end - arena->next) < size && !NewBlock(arena, size))
+		return NULL;
+
+	void* ret = arena->next;
+	arena->next += size;
+	arena->used += size;
+	return ret;
+}
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "lexer.h"
+#include "incremental.h"
+#include "flat-ast.h"
+#include "expr-pool.h"
+#include "irgen.h"
+#include "map.h"
+
+#define BENCH_ROUNDS 20
+
+static double Now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Report(const char* name, uint64_t tokens, double secs) {
+	printf("%-24s %10lu tokens %8.3f ms %12.0f tokens/sec\n", name, 
+			tokens, secs * 1e3, tokens / secs);
+}
+
+static int BenchBatch(const char* name, const char* file, uint32_t flags,
+		uint32_t threads) {
+	uint64_t ntokens = 0;
+	double start = Now();
+
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		Lexer lexer;
+		if (NewLexer(file, &lexer))
+			return 1;
+
+		lexer.flags |= flags;
+		lexer.threads = threads;
+		if (LexAll(&lexer))
+			return 1;
+
+		ntokens += lexer.ntokens - 1; // don't count TT_EOF
+		DeleteLexer(&lexer);
+	}
+
+	Report(name, ntokens, Now() - start);
+	return 0;
+}
+
+// Compares pulling tokens one at a time through Next(), which allocates
+// every token on the heap, against lexing the file into one token array,
+// with both of the lexers, on one thread and on one thread per core
+int BenchLexer(const char* file) {
+	uint64_t ntokens = 0;
+	double start = Now();
+
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		Lexer lexer;
+		if (NewLexer(file, &lexer))
+			return 1;
+
+		while (Next(&lexer)->type != TT_EOF)
+			ntokens++;
+
+		DeleteLexer(&lexer);
+	}
+
+	Report("lexer (token at a time)", ntokens, Now() - start);
+
+	BenchBatch("lexer (batch)", file, 0, 1);
+	BenchBatch("lexer (batch, DFA)", file, LEXER_DFA, 1);
+	BenchBatch("lexer (parallel)", file, 0, 0);
+	BenchBatch("lexer (parallel, DFA)", file, LEXER_DFA, 0);
+	return 0;
+}
+
+// The memory in use by an expression tree, the names are shared, see names.h
+static size_t ExprBytes(Expr* expr) {
+	size_t bytes = 0;
+	ExprWalk walk;
+
+	BeginExprWalk(&walk, expr);
+	while ((expr = NextExpr(&walk))) {
+		bytes += sizeof(Expr);
+		switch (expr->type) {
+			case ET_INT_LITERAL: bytes += sizeof(IntLiteral); break;
+			case ET_UNARY_OP: bytes += sizeof(UnaryOp); break;
+			case ET_BINARY_OP: bytes += sizeof(BinaryOp); break;
+			case ET_CAST: bytes += sizeof(Cast); break;
+			default: break;
+		}
+	}
+
+	EndExprWalk(&walk);
+	return bytes;
+}
+
+static int64_t SumTree(Expr* expr) {
+	int64_t sum = 0;
+	ExprWalk walk;
+
+	BeginExprWalk(&walk, expr);
+	while ((expr = NextExpr(&walk)))
+		if (expr->type == ET_INT_LITERAL)
+			sum += expr->literal->number;
+
+	EndExprWalk(&walk);
+	return sum;
+}
+
+// Compares the size of the expressions as trees and as a FlatAst, and the
+// time it takes to visit every node of them
+static int BenchFlatAst(Lexer* lexer) {
+	Vector* stats = NewVector();
+	Vector* exprs = NewVector();
+	FlatAst ast;
+	size_t tree = 0;
+
+	InitFlatAst(&ast);
+	lexer->cursor = 0;
+	while (Peek(lexer)->type != TT_EOF) {
+		Statement* stat = ParseStatement(lexer);
+		if (!stat || !Append(stats, stat))
+			return 1;
+
+		Expr* expr = (stat->type == ST_EXPR) ? stat->expr :
+			(stat->type == ST_VARDECL) ? stat->vardecl->init : NULL;
+		if (!expr)
+			continue;
+
+		if (!Append(exprs, expr))
+			return 1;
+
+		tree += ExprBytes(expr);
+		if (FlattenExpr(&ast, expr) == UINT32_MAX)
+			return 1;
+	}
+
+	int64_t sums[2] = { 0, 0 };
+	double start = Now();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+		for (uint32_t i = 0; i < VectorLength(exprs); i++)
+			sums[0] += SumTree(Get(exprs, i));
+
+	double secs = Now() - start;
+	printf("%-24s %10zu bytes      %8.3f ms\n", "ast (tree)", tree, secs * 1e3);
+
+	start = Now();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+		for (uint32_t node = 0; node < ast.nnodes; node++)
+			if (ast.kinds[node] == ET_INT_LITERAL)
+				sums[1] += ast.literals[ast.args[node]].number;
+
+	secs = Now() - start;
+	printf("%-24s %10zu bytes      %8.3f ms\n", "ast (flat)", 
+			FlatAstBytes(&ast), secs * 1e3);
+
+	for (uint32_t i = 0; i < VectorLength(stats); i++)
+		DeleteStatement(Get(stats, i));
+
+	DeleteVector(stats);
+	DeleteVector(exprs);
+	DeleteFlatAst(&ast);
+	return sums[0] != sums[1];
+}
+
+// The memory in use by the expressions once identical subtrees are shared,
+// next to the trees of BenchFlatAst(), and the time it takes to parse them
+// that way. The parser only shares the subtrees without names, the rest 
+// are shared by sema, which is not timed
+static int BenchExprPool(Lexer* lexer) {
+	ExprPool pool;
+	InitExprPool(&pool);
+
+	uint64_t nstats = 0;
+	double start = Now();
+	lexer->pool = &pool;
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		lexer->cursor = 0;
+		while (Peek(lexer)->type != TT_EOF) {
+			Statement* stat = ParseStatement(lexer);
+			if (!stat)
+				return 1;
+
+			DeleteStatement(stat);
+			nstats++;
+		}
+	}
+
+	double secs = Now() - start;
+	printf("%-24s %10lu statements %8.3f ms %12.0f statements/sec\n", 
+			"parser (hash-consed)", nstats, secs * 1e3, nstats / secs);
+
+	// Once more, without the nodes of the rounds above in the pool
+	DeleteExprPool(&pool);
+	Vector* stats = NewVector();
+	lexer->cursor = 0;
+	while (Peek(lexer)->type != TT_EOF) {
+		Statement* stat = ParseStatement(lexer);
+		if (!stat || !Append(stats, stat))
+			return 1;
+	}
+
+	Arena arena;
+	InitArena(&arena, 0);
+	SymbolTable* symtab = SemanticAnalyse(lexer, stats, &arena, 1);
+	lexer->pool = NULL;
+
+	printf("%-24s %10zu bytes      %10u unique nodes, %lu shared\n", 
+			"ast (hash-consed)", ExprPoolBytes(&pool), pool.count, 
+			pool.hits);
+
+	for (uint32_t i = 0; i < VectorLength(stats); i++)
+		DeleteStatement(Get(stats, i));
+
+	DeleteVector(stats);
+	DeleteExprPool(&pool);
+	DeleteSymbolTable(symtab);
+	DeleteArena(&arena);
+	return !symtab;
+}
+
+// Parses the tokens of the file over and over, on one thread, skipping the
+// function bodies, into an arena, and on one thread per core, lexing is not
+// timed
+int BenchParser(const char* file) {
+	Lexer lexer;
+	if (NewLexer(file, &lexer) || LexAll(&lexer))
+		return 1;
+
+	uint64_t nstats = 0;
+	double start = Now();
+
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		lexer.cursor = 0;
+		while (Peek(&lexer)->type != TT_EOF) {
+			Statement* stat = ParseStatement(&lexer);
+			if (!stat)
+				return 1;
+
+			DeleteStatement(stat);
+			nstats++;
+		}
+	}
+
+	double secs = Now() - start;
+	printf("%-24s %10lu statements %8.3f ms %12.0f statements/sec\n", 
+			"parser", nstats, secs * 1e3, nstats / secs);
+
+	nstats = 0;
+	start = Now();
+	lexer.flags |= LEXER_LAZY;
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		lexer.cursor = 0;
+		while (Peek(&lexer)->type != TT_EOF) {
+			Statement* stat = ParseStatement(&lexer);
+			if (!stat)
+				return 1;
+
+			DeleteStatement(stat);
+			nstats++;
+		}
+	}
+
+	lexer.flags &= ~LEXER_LAZY;
+	secs = Now() - start;
+	printf("%-24s %10lu statements %8.3f ms %12.0f statements/sec\n", 
+			"parser (lazy bodies)", nstats, secs * 1e3, nstats / secs);
+
+	// The statements are not deleted one by one, but with the arena
+	Arena arena;
+	InitArena(&arena, 0);
+	nstats = 0;
+	start = Now();
+	lexer.arena = &arena;
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		lexer.cursor = 0;
+		while (Peek(&lexer)->type != TT_EOF) {
+			if (!ParseStatement(&lexer))
+				return 1;
+
+			nstats++;
+		}
+
+		DeleteArena(&arena);
+	}
+
+	lexer.arena = NULL;
+	secs = Now() - start;
+	printf("%-24s %10lu statements %8.3f ms %12.0f statements/sec\n", 
+			"parser (arena)", nstats, secs * 1e3, nstats / secs);
+
+	nstats = 0;
+	start = Now();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		Vector* stats = NewVector();
+		lexer.cursor = 0;
+		ParseParallel(&lexer, stats, 0);
+
+		// What is left over, like all of it with a single core
+		while (Peek(&lexer)->type != TT_EOF) {
+			Statement* stat = ParseStatement(&lexer);
+			if (!stat || !Append(stats, stat))
+				return 1;
+		}
+
+		nstats += VectorLength(stats);
+		for (uint32_t i = 0; i < VectorLength(stats); i++)
+			DeleteStatement(Get(stats, i));
+
+		DeleteVector(stats);
+	}
+
+	secs = Now() - start;
+	printf("%-24s %10lu statements %8.3f ms %12.0f statements/sec\n", 
+			"parser (parallel)", nstats, secs * 1e3, nstats / secs);
+
+	int err = BenchFlatAst(&lexer) || BenchExprPool(&lexer);
+	DeleteLexer(&lexer);
+	return err;
+}
+
+#define BENCH_EDITS 1000
+
+// Times typing at the start of a line in the middle of the file, and 
+// deleting it again, against parsing the whole file again every time
+int BenchIncremental(const char* file) {
+	Lexer lexer;
+	if (NewLexer(file, &lexer))
+		return 1;
+
+	Document doc;
+	double start = Now();
+	DocumentError err = NewDocument(file, lexer.source, lexer.size, 
+			LEXER_QUIET, &doc);
+	double full = Now() - start;
+	DeleteLexer(&lexer);
+	if (err)
+		return 1;
+
+	uint32_t offset = doc.size / 2;
+	while (offset && doc.text[offset - 1] != '\n')
+		offset--;
+
+	// A blank only moves things, a statement has to be parsed
+	const char* typed[] = { " ", "1;" };
+	const char* names[] = { "edit (blank)", "edit (statement)" };
+	printf("%-24s %10u statements %8.3f ms\n", "parse (whole file)", 
+			doc.nstats, full * 1e3);
+
+	for (int i = 0; i < 2; i++) {
+		uint32_t length = strlen(typed[i]);
+		DocumentChange change;
+
+		start = Now();
+		for (int edit = 0; edit < BENCH_EDITS; edit++) {
+			err |= EditDocument(&doc, offset, 0, typed[i], length, &change);
+			err |= EditDocument(&doc, offset, length, "", 0, &change);
+		}
+
+		printf("%-24s %10u edits      %8.3f ms each\n", names[i], 
+				2 * BENCH_EDITS, (Now() - start) * 1e3 / (2 * BENCH_EDITS));
+	}
+
+	DeleteDocument(&doc);
+	return err != DOC_SUCCESS;
+}
+
+// Looks up the name of every identifier of the file among the distinct
+// names, scanning them with strcmp() like a list would, and with a Map
+int BenchMap(const char* file) {
+	Lexer lexer;
+	if (NewLexer(file, &lexer))
+		return 1;
+
+	lexer.flags |= LEXER_QUIET;
+	if (LexAll(&lexer)) {
+		DeleteLexer(&lexer);
+		return 1;
+	}
+
+	// The names, one after the other, and where each of them starts
+	uint32_t count = 0, unique = 0, length = 0;
+	for (uint32_t i = 0; i < lexer.ntokens; i++) {
+		if (lexer.tokens[i].type == TT_IDENT) {
+			count++;
+			length += lexer.tokens[i].length + 1;
+		}
+	}
+
+	char* names = malloc(length + 1);
+	uint32_t* starts = malloc((count + 1) * sizeof(uint32_t));
+	char** keys = malloc((count + 1) * sizeof(char*));
+	Map* map = NewMap(HashString, CompareStrings);
+	int err = !names || !starts || !keys || !map;
+
+	char* name = names;
+	for (uint32_t i = 0, n = 0; !err && i < lexer.ntokens; i++) {
+		Token* token = &lexer.tokens[i];
+		if (token->type != TT_IDENT)
+			continue;
+
+		memcpy(name, TokenText(&lexer, token), token->length);
+		name[token->length] = 0;
+		starts[n++] = name - names;
+		if (!MapGet(map, name)) {
+			keys[unique] = name;
+			err |= !MapInsert(map, name, &keys[unique++]);
+		}
+
+		name += token->length + 1;
+	}
+
+	uint64_t found[2] = { 0, 0 };
+	double start = Now();
+	for (uint32_t i = 0; !err && i < count; i++) {
+		for (uint32_t k = 0; k < unique; k++) {
+			if (strcmp(keys[k], names + starts[i]) == 0) {
+				found[0]++;
+				break;
+			}
+		}
+	}
+
+	double linear = Now() - start;
+	start = Now();
+	for (int round = 0; !err && round < BENCH_ROUNDS; round++)
+		for (uint32_t i = 0; i < count; i++)
+			found[1] += MapGet(map, names + starts[i]) != NULL;
+
+	double hashed = (Now() - start) / BENCH_ROUNDS;
+	if (!err) {
+		printf("%-24s %10u lookups    %8.3f ms %12.0f lookups/sec\n",
+				"names (linear)", count, linear * 1e3, count / linear);
+		printf("%-24s %10u lookups    %8.3f ms %12.0f lookups/sec\n",
+				"names (map)", count, hashed * 1e3, count / hashed);
+		printf("%-24s %10u names      %10u slots\n", "map", unique,
+				map->capacity);
+	}
+
+	err |= found[0] * BENCH_ROUNDS != found[1] || found[0] != count;
+	DeleteMap(map);
+	free(keys);
+	free(starts);
+	free(names);
+	DeleteLexer(&lexer);
+	return err;
+}
+
+// Folds -(-x) into x, rewriting the operands of every later instruction 
+// for each fold, as it takes without the uses of a value
+static uint32_t FoldScanning(IRInst* insts, uint32_t ninsts) {
+	uint32_t folded = 0;
+	for (IRValue value = 0; value < ninsts; value++) {
+		IRInst* inst = &insts[value];
+		if (inst->code != IR_NEG || insts[inst->args[0]].code != IR_NEG)
+			continue;
+
+		IRValue x = insts[inst->args[0]].args[0];
+		for (IRValue user = value + 1; user < ninsts; user++)
+			for (int i = 0; i < IROperands(insts[user].code); i++)
+				if (insts[user].args[i] == value)
+					insts[user].args[i] = x;
+
+		folded++;
+	}
+
+	return folded;
+}
+
+static uint32_t FoldWithUses(IR* ir) {
+	uint32_t folded = 0;
+	for (IRValue value = 0; value < ir->ninsts; value++) {
+		IRInst* inst = IRInstOf(ir, value);
+		if (inst->code != IR_NEG)
+			continue;
+
+		IRInst* operand = IRInstOf(ir, IROperand(ir, inst, 0));
+		if (operand->code != IR_NEG)
+			continue;
+
+		// The outer neg is dead, and so is the inner one if it was its only
+		// user
+		ReplaceAllUsesWith(ir, value, IROperand(ir, operand, 0));
+		IRRemoveUses(ir, value);
+		folded++;
+	}
+
+	return folded;
+}
+
+// Times a peephole fold over the IR of the file, rewriting the uses of a
+// value by scanning the instructions after it, and with the lists of uses
+int BenchIR(const char* file) {
+	Lexer lexer;
+	if (NewLexer(file, &lexer) || LexAll(&lexer))
+		return 1;
+
+	Arena arena;
+	InitArena(&arena, 0);
+	lexer.arena = &arena;
+	lexer.flags |= LEXER_QUIET;
+
+	Vector* stats = NewVector();
+	Statement* stat;
+	while (Peek(&lexer)->type != TT_EOF && (stat = ParseStatement(&lexer)))
+		if (!Append(stats, stat))
+			break;
+
+	IR ir;
+	InitIR(&ir);
+	SymbolTable* symtab = SemanticAnalyse(&lexer, stats, &arena, 0);
+	int err = !symtab || !GenIR(&ir, stats, &arena);
+
+	IRInst* insts = malloc(ir.ninsts * sizeof(IRInst) + 1);
+	err |= !insts;
+	if (!err) {
+		memcpy(insts, ir.insts, ir.ninsts * sizeof(IRInst));
+		double start = Now();
+		uint32_t scanned = FoldScanning(insts, ir.ninsts);
+		double scanning = Now() - start;
+
+		start = Now();
+		uint32_t folded = FoldWithUses(&ir);
+		ResolveOperands(&ir);
+		double uses = Now() - start;
+
+		printf("%-24s %10u folds      %8.3f ms %12.0f insts/sec\n",
+				"fold (scanning)", scanned, scanning * 1e3, 
+				ir.ninsts / scanning);
+		printf("%-24s %10u folds      %8.3f ms %12.0f insts/sec\n",
+				"fold (use lists)", folded, uses * 1e3, ir.ninsts / uses);
+
+		err |= scanned != folded;
+		for (IRValue value = 0; value < ir.ninsts; value++)
+			err |= insts[value].args[0] != ir.insts[value].args[0] ||
+				insts[value].args[1] != ir.insts[value].args[1];
+	}
+
+	free(insts);
+	DeleteIR(&ir);
+	DeleteSymbolTable(symtab);
+	DeleteVector(stats);
+	DeleteArena(&arena);
+	DeleteLexer(&lexer);
+	return err;
+}
+
+int RunBenchmark(const char* which, const char* file) {
+	if (strcmp(which, "lexer") == 0)
+		return BenchLexer(file);
+
+	if (strcmp(which, "parser") == 0)
+		return BenchParser(file);
+
+	if (strcmp(which, "incremental") == 0)
+		return BenchIncremental(file);
+
+	if (strcmp(which, "map") == 0)
+		return BenchMap(file);
+
+	if (strcmp(which, "ir") == 0)
+		return BenchIR(file);
+
+	printf("Unknown benchmark %s\n", which);
+	return 1;
+}
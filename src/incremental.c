@@ -0,0 +1,694 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "incremental.h"
+#include "scan.h"
+#include "lexer-private.h"
+
+/* Every line is lexed on its own, since no token spans a newline and being
+ * inside a // comment ends at one. So after an edit, only the lines that
+ * the edit touched are lexed again, and the tokens of the lines after it
+ * are kept, moved by the number of bytes added or removed.
+ *
+ * Statements are parsed again from the one holding the first token that
+ * changed, until the parser ends up at the start of a statement that only
+ * holds tokens after the edit. That one and the rest are kept. No statement
+ * looks at any token after its ';' or '}', so those parse the same way.
+ *
+ * The offsets of the tokens after the edit are moved in one tight pass. 
+ * The locations in the statements after it are only moved once someone 
+ * asks for the statement, see DocumentStatement() */
+
+// Lexes the lines of the text between start and end
+static DocumentError LexLines(Document* doc, uint32_t start, uint32_t end,
+		Token** out, uint32_t* count) {
+	Lexer lexer = doc->lexer;
+	lexer.size = end;
+	lexer.offset = start;
+	lexer.lines = NULL;
+	lexer.nlines = 0;
+	lexer.tokens = NULL;
+
+	jmp_buf bail;
+	*out = NULL;
+	if (setjmp(bail)) {
+		free(*out);
+		*out = NULL;
+		return DOC_UNKNOWN_TOKEN;
+	}
+
+	lexer.bail = &bail;
+	if (LexRange(&lexer, out, count))
+		return DOC_OUT_OF_MEMORY;
+
+	return DOC_SUCCESS;
+}
+
+static void ShiftExpr(Expr* expr, uint32_t from, int32_t delta) {
+	ExprWalk walk;
+	BeginExprWalk(&walk, expr);
+
+	while ((expr = NextExpr(&walk))) {
+		if (expr->loc.offset >= from)
+			expr->loc.offset += delta;
+
+		if (expr->type == ET_UNARY_OP && expr->unop->loc.offset >= from)
+			expr->unop->loc.offset += delta;
+		else if (expr->type == ET_BINARY_OP && expr->binop->loc.offset >= from)
+			expr->binop->loc.offset += delta;
+	}
+
+	EndExprWalk(&walk);
+}
+
+// Moves every location at or after from by delta bytes
+static void ShiftStatement(Statement* stat, uint32_t from, int32_t delta) {
+	if (stat->loc.offset >= from)
+		stat->loc.offset += delta;
+
+	if (stat->type == ST_EXPR)
+		ShiftExpr(stat->expr, from, delta);
+	else if (stat->type == ST_VARDECL) {
+		VarDecl* decl = stat->vardecl;
+		if (decl->loc.offset >= from)
+			decl->loc.offset += delta;
+
+		if (decl->type && decl->loc_type.offset >= from)
+			decl->loc_type.offset += delta;
+
+		if (decl->init)
+			ShiftExpr(decl->init, from, delta);
+	}
+	else if (stat->type == ST_FUNCTION) {
+		Function* func = stat->func;
+		if (func->open.offset >= from)
+			func->open.offset += delta;
+
+		if (func->close.offset >= from)
+			func->close.offset += delta;
+
+		Vector* body = func->statements;
+		for (uint32_t i = 0; i < VectorLength(body); i++)
+			ShiftStatement(Get(body, i), from, delta);
+	}
+}
+
+// Index of the first token at or after offset
+static uint32_t FindToken(Lexer* lexer, uint32_t offset) {
+	uint32_t lo = 0, hi = lexer->ntokens;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (lexer->tokens[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+// Index of the statement that holds the token, or Document.nstats
+static uint32_t FindStatement(Document* doc, uint32_t token) {
+	if (token >= doc->parsed)
+		return doc->nstats;
+
+	uint32_t lo = 0, hi = doc->nstats;
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (doc->starts[mid] <= token)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int ReserveStatements(Document* doc, uint32_t count) {
+	if (count <= doc->max_stats)
+		return 1;
+
+	uint32_t capacity = doc->max_stats ? doc->max_stats : 64;
+	while (capacity < count)
+		capacity *= 2;
+
+	Statement** stats = realloc(doc->stats, sizeof(Statement*) * capacity);
+	if (!stats)
+		return 0;
+
+	doc->stats = stats;
+	uint32_t* starts = realloc(doc->starts, sizeof(uint32_t) * capacity);
+	if (!starts)
+		return 0;
+
+	doc->starts = starts;
+	int32_t* moved = realloc(doc->moved, sizeof(int32_t) * capacity);
+	if (!moved)
+		return 0;
+
+	doc->moved = moved;
+	doc->max_stats = capacity;
+	return 1;
+}
+
+/* Parses the statements from statement first on again. The statements from
+ * the first one that starts at old token sync or later are kept, once the
+ * parser gets to their first token, which has moved by tokens */
+static DocumentError Reparse(Document* doc, uint32_t first, uint32_t sync,
+		int32_t tokens, int32_t bytes, DocumentChange* change) {
+	Lexer* lexer = &doc->lexer;
+	lexer->cursor = (first < doc->nstats) ? doc->starts[first] : doc->parsed;
+
+	Statement** stats = NULL;
+	uint32_t* starts = NULL;
+	uint32_t nstats = 0, capacity = 0;
+
+	DocumentError err = DOC_SUCCESS;
+	uint32_t keep = first;
+	int synced = 0;
+	while (1) {
+		// Skip the old statements that the parser has gone past
+		while (keep < doc->nstats && (doc->starts[keep] < sync ||
+				(int64_t) doc->starts[keep] + tokens < lexer->cursor))
+			keep++;
+
+		if (keep < doc->nstats &&
+				(int64_t) doc->starts[keep] + tokens == lexer->cursor) {
+			synced = 1;
+			break;
+		}
+
+		if (Peek(lexer)->type == TT_EOF)
+			break;
+
+		if (nstats == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			stats = realloc(stats, sizeof(Statement*) * capacity);
+			starts = realloc(starts, sizeof(uint32_t) * capacity);
+			if (!stats || !starts) {
+				err = DOC_OUT_OF_MEMORY;
+				break;
+			}
+		}
+
+		uint32_t start = lexer->cursor;
+		Statement* stat = ParseStatement(lexer);
+		if (!stat) {
+			lexer->cursor = start;
+			err = DOC_PARSE_ERROR;
+			break;
+		}
+
+		stats[nstats] = stat;
+		starts[nstats++] = start;
+	}
+
+	uint32_t parsed = lexer->cursor;
+	if (!synced)
+		keep = doc->nstats;
+	else if (doc->parsed != lexer->ntokens - tokens - 1) {
+		// The statements we keep end in a parse error
+		parsed = doc->parsed + tokens;
+		err = DOC_PARSE_ERROR;
+	} else
+		parsed = lexer->ntokens - 1;
+
+	uint32_t kept = doc->nstats - keep;
+	if (err == DOC_OUT_OF_MEMORY ||
+			!ReserveStatements(doc, first + nstats + kept)) {
+		for (uint32_t i = 0; i < nstats; i++)
+			DeleteStatement(stats[i]);
+
+		free(stats);
+		free(starts);
+		return DOC_OUT_OF_MEMORY;
+	}
+
+	for (uint32_t i = first; i < keep; i++)
+		DeleteStatement(doc->stats[i]);
+
+	if (kept) {
+		memmove(doc->stats + first + nstats, doc->stats + keep,
+				sizeof(Statement*) * kept);
+		memmove(doc->starts + first + nstats, doc->starts + keep,
+				sizeof(uint32_t) * kept);
+		memmove(doc->moved + first + nstats, doc->moved + keep,
+				sizeof(int32_t) * kept);
+	}
+
+	if (nstats) {
+		memcpy(doc->stats + first, stats, sizeof(Statement*) * nstats);
+		memcpy(doc->starts + first, starts, sizeof(uint32_t) * nstats);
+		memset(doc->moved + first, 0, sizeof(int32_t) * nstats);
+	}
+
+	for (uint32_t i = first + nstats; i < first + nstats + kept; i++) {
+		doc->starts[i] += tokens;
+		doc->moved[i] += bytes;
+	}
+
+	change->first = first;
+	change->removed = keep - first;
+	change->inserted = nstats;
+
+	doc->nstats = first + nstats + kept;
+	doc->parsed = parsed;
+
+	free(stats);
+	free(starts);
+	return err;
+}
+
+// Drops every statement, until the whole text is lexed and parsed again
+static void Invalidate(Document* doc, DocumentChange* change) {
+	for (uint32_t i = 0; i < doc->nstats; i++)
+		DeleteStatement(doc->stats[i]);
+
+	change->first = 0;
+	change->removed = doc->nstats;
+	change->inserted = 0;
+	doc->nstats = 0;
+	doc->parsed = 0;
+	doc->stale = 1;
+}
+
+// Lexes and parses the whole text again
+static DocumentError Rebuild(Document* doc, DocumentChange* change) {
+	Lexer* lexer = &doc->lexer;
+
+	Token* tokens = NULL;
+	uint32_t ntokens = 0;
+	DocumentError err = LexLines(doc, 0, doc->size, &tokens, &ntokens);
+
+	Invalidate(doc, change);
+	if (err)
+		return err;
+
+	free(lexer->tokens);
+	lexer->tokens = tokens;
+	lexer->ntokens = ntokens;
+	lexer->flags |= LEXER_BATCH;
+	doc->stale = 0;
+
+	return Reparse(doc, 0, 0, 0, 0, change);
+}
+
+DocumentError NewDocument(const char* name, const char* text, uint32_t size,
+		uint32_t flags, Document* doc) {
+	doc->capacity = size + 64;
+	doc->text = malloc(doc->capacity);
+	if (!doc->text)
+		return DOC_OUT_OF_MEMORY;
+
+	memcpy(doc->text, text, size);
+	doc->size = size;
+
+	if (NewBufferLexer(name, doc->text, size, &doc->lexer)) {
+		free(doc->text);
+		return DOC_OUT_OF_MEMORY;
+	}
+
+	// Skipped bodies would point at token indices that edits move around
+	doc->lexer.flags |= flags & ~LEXER_LAZY;
+	doc->stats = NULL;
+	doc->starts = NULL;
+	doc->moved = NULL;
+	doc->nstats = 0;
+	doc->max_stats = 0;
+	doc->parsed = 0;
+	doc->stale = 1;
+
+	DocumentChange change;
+	return Rebuild(doc, &change);
+}
+
+void DeleteDocument(Document* doc) {
+	for (uint32_t i = 0; i < doc->nstats; i++)
+		DeleteStatement(doc->stats[i]);
+
+	free(doc->stats);
+	free(doc->starts);
+	free(doc->moved);
+	DeleteLexer(&doc->lexer);
+	free(doc->text);
+}
+
+// Replaces removed bytes at offset with the new text
+static int SpliceText(Document* doc, uint32_t offset, uint32_t removed,
+		const char* text, uint32_t length) {
+	uint32_t size = doc->size - removed + length;
+	if (size > doc->capacity) {
+		uint32_t capacity = doc->capacity * 2 > size ? doc->capacity * 2 : size;
+		char* grown = realloc(doc->text, capacity);
+		if (!grown)
+			return 0;
+
+		doc->text = grown;
+		doc->capacity = capacity;
+	}
+
+	memmove(doc->text + offset + length, doc->text + offset + removed,
+			doc->size - offset - removed);
+	memcpy(doc->text + offset, text, length);
+	doc->size = size;
+
+	Lexer* lexer = &doc->lexer;
+	lexer->source = doc->text;
+	lexer->size = size;
+	free(lexer->lines);
+	lexer->lines = NULL;
+	lexer->nlines = 0;
+	return 1;
+}
+
+/* The locations of the statements after an edit are only moved when they
+ * are asked for, so that an edit does not have to walk all of them */
+Statement* DocumentStatement(Document* doc, uint32_t index) {
+	if (doc->moved[index]) {
+		ShiftStatement(doc->stats[index], 0, doc->moved[index]);
+		doc->moved[index] = 0;
+	}
+
+	return doc->stats[index];
+}
+
+/* Replaces removed bytes at offset with length bytes of text, and brings
+ * the tokens and statements up to date. The statements that changed are
+ * reported in change */
+DocumentError EditDocument(Document* doc, uint32_t offset, uint32_t removed,
+		const char* text, uint32_t length, DocumentChange* change) {
+	if ((uint64_t) offset + removed > doc->size ||
+			(uint64_t) doc->size - removed + length > UINT32_MAX)
+		return DOC_INVALID_EDIT;
+
+	change->first = change->removed = change->inserted = 0;
+	if (doc->stale) {
+		if (!SpliceText(doc, offset, removed, text, length))
+			return DOC_OUT_OF_MEMORY;
+
+		return Rebuild(doc, change);
+	}
+
+	Lexer* lexer = &doc->lexer;
+	int32_t delta = (int32_t) length - (int32_t) removed;
+
+	// The lines that the edit touches, before the edit
+	uint32_t start = offset;
+	while (start && doc->text[start - 1] != '\n')
+		start--;
+
+	uint32_t end = ScanLine(doc->text, offset + removed, doc->size);
+	end = (end < doc->size) ? end + 1 : end;
+
+	char* old = malloc(end - start + 1);
+	if (!old)
+		return DOC_OUT_OF_MEMORY;
+
+	memcpy(old, doc->text + start, end - start);
+	if (!SpliceText(doc, offset, removed, text, length)) {
+		free(old);
+		return DOC_OUT_OF_MEMORY;
+	}
+
+	Token* tokens = NULL;
+	uint32_t ntokens = 0;
+	DocumentError err = LexLines(doc, start, end + delta, &tokens, &ntokens);
+	if (err) {
+		free(old);
+		if (err == DOC_UNKNOWN_TOKEN)
+			Invalidate(doc, change);
+
+		return err;
+	}
+
+	ntokens--; // the TT_EOF at the end of the lines
+
+	// The old tokens of those lines are [first, last)
+	uint32_t first = FindToken(lexer, start);
+	uint32_t last = FindToken(lexer, end);
+	int32_t moved = (int32_t) ntokens - (int32_t) (last - first);
+
+	// When the tokens have the same text, as when editing a comment or
+	// the blanks between tokens, the statements only have to be moved
+	int same = !moved;
+	for (uint32_t i = 0; same && i < ntokens; i++) {
+		Token* was = &lexer->tokens[first + i];
+		Token* now = &tokens[i];
+		uint32_t at = was->offset + (was->offset >= offset + removed ? delta : 0);
+		same = was->type == now->type && was->length == now->length &&
+			at == now->offset &&
+			!memcmp(old + (was->offset - start), doc->text + now->offset,
+					now->length);
+	}
+
+	free(old);
+
+	uint32_t total = lexer->ntokens + moved;
+	if (moved > 0) {
+		Token* grown = realloc(lexer->tokens, sizeof(Token) * total);
+		if (!grown) {
+			free(tokens);
+			return DOC_OUT_OF_MEMORY;
+		}
+
+		lexer->tokens = grown;
+	}
+
+	if (moved) {
+		memmove(lexer->tokens + last + moved, lexer->tokens + last,
+				sizeof(Token) * (lexer->ntokens - last));
+	}
+
+	memcpy(lexer->tokens + first, tokens, sizeof(Token) * ntokens);
+	lexer->ntokens = total;
+	free(tokens);
+
+	for (uint32_t i = first + ntokens; delta && i < total; i++)
+		lexer->tokens[i].offset += delta;
+
+	uint32_t stat = FindStatement(doc, first);
+	if (same) {
+		// Only statements with tokens on the lines of the edit may have some
+		// locations before it and some after
+		uint32_t i = stat;
+		for (; i < doc->nstats && doc->starts[i] < last; i++)
+			ShiftStatement(DocumentStatement(doc, i), offset + removed, delta);
+
+		for (; i < doc->nstats; i++)
+			doc->moved[i] += delta;
+
+		change->first = stat;
+		return (doc->parsed + 1 == total) ? DOC_SUCCESS : DOC_PARSE_ERROR;
+	}
+
+	return Reparse(doc, stat, last, moved, delta, change);
+}
+
+static int SameExpr(Expr* a, Expr* b) {
+	if (a->type != b->type || a->loc.offset != b->loc.offset)
+		return 0;
+
+	switch (a->type) {
+		case ET_INT_LITERAL:
+			return a->literal->number == b->literal->number &&
+				a->literal->type == b->literal->type;
+		case ET_IDENT:
+			return a->ident == b->ident;
+		case ET_UNARY_OP:
+			return a->unop->type == b->unop->type &&
+				a->unop->loc.offset == b->unop->loc.offset &&
+				SameExpr(a->unop->operand, b->unop->operand);
+		case ET_BINARY_OP:
+			return a->binop->type == b->binop->type &&
+				a->binop->loc.offset == b->binop->loc.offset &&
+				SameExpr(a->binop->left, b->binop->left) &&
+				SameExpr(a->binop->right, b->binop->right);
+		case ET_CAST:
+			return a->cast->target == b->cast->target &&
+				SameExpr(a->cast->expr, b->cast->expr);
+	}
+
+	return 0;
+}
+
+static int SameStatement(Statement* a, Statement* b) {
+	if (a->type != b->type)
+		return 0;
+
+	if (a->type == ST_EXPR)
+		return a->loc.offset == b->loc.offset && SameExpr(a->expr, b->expr);
+
+	if (a->type == ST_VARDECL) {
+		VarDecl* x = a->vardecl;
+		VarDecl* y = b->vardecl;
+		if (a->loc.offset != b->loc.offset || x->loc.offset != y->loc.offset ||
+				x->ident != y->ident || x->type != y->type)
+			return 0;
+
+		if (x->type && x->loc_type.offset != y->loc_type.offset)
+			return 0;
+
+		return (!x->init || !y->init) ? x->init == y->init 
+			: SameExpr(x->init, y->init);
+	}
+
+	Function* x = a->func;
+	Function* y = b->func;
+	if (x->name != y->name || x->rtype != y->rtype ||
+			VectorLength(x->args) != VectorLength(y->args) ||
+			VectorLength(x->statements) != VectorLength(y->statements))
+		return 0;
+
+	for (uint32_t i = 0; i < VectorLength(x->args); i++) {
+		FuncArgs* p = Get(x->args, i);
+		FuncArgs* q = Get(y->args, i);
+		if (p->name != q->name || p->type != q->type)
+			return 0;
+	}
+
+	for (uint32_t i = 0; i < VectorLength(x->statements); i++) {
+		if (!SameStatement(Get(x->statements, i), Get(y->statements, i)))
+			return 0;
+	}
+
+	return 1;
+}
+
+// Compares a document against one built from its text
+static int SameDocument(Document* doc, DocumentError err) {
+	Document fresh;
+	DocumentError expect = NewDocument(doc->lexer.file, doc->text, doc->size,
+			doc->lexer.flags & (LEXER_DFA | LEXER_QUIET), &fresh);
+
+	int same = err == expect && doc->nstats == fresh.nstats &&
+		doc->parsed == fresh.parsed && doc->stale == fresh.stale;
+
+	if (same && !doc->stale) {
+		same = doc->lexer.ntokens == fresh.lexer.ntokens &&
+			!memcmp(doc->lexer.tokens, fresh.lexer.tokens, 
+					sizeof(Token) * fresh.lexer.ntokens);
+	}
+
+	for (uint32_t i = 0; same && i < doc->nstats; i++) {
+		same = doc->starts[i] == fresh.starts[i] &&
+			SameStatement(DocumentStatement(doc, i), fresh.stats[i]);
+	}
+
+	DeleteDocument(&fresh);
+	return same;
+}
+
+#define CHECK_EDITS 5000
+
+/* Makes random edits to the file: deleting and copying lines, typing and 
+ * pasting bits of the text, and checks that the document matches one 
+ * parsed from scratch after every edit */
+int CheckIncremental(const char* name) {
+	Lexer file;
+	if (NewLexer(name, &file))
+		return 0;
+
+	Document doc;
+	DocumentError err = NewDocument(name, file.source, file.size, 
+			LEXER_QUIET, &doc);
+	DeleteLexer(&file);
+	if (err == DOC_OUT_OF_MEMORY)
+		return 0;
+
+	static const char typed[] = " \n\t;:=+-*/()0123456789abxlet//@";
+	uint32_t seed = 2463534242;
+
+#define RANDOM(n) (seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5, \
+		(n) ? seed % (n) : 0)
+
+	int clean = 0;
+	for (int i = 0; i < CHECK_EDITS; i++) {
+		uint32_t offset = RANDOM(doc.size + 1), removed = 0;
+		const char* text = doc.text;
+		uint32_t length = 0;
+		char paste[64];
+
+		switch (RANDOM(4)) {
+			case 0: { // delete the line
+				while (offset && doc.text[offset - 1] != '\n')
+					offset--;
+
+				removed = ScanLine(doc.text, offset, doc.size) - offset;
+				removed += offset + removed < doc.size;
+				break;
+			}
+
+			case 1: { // copy some line to the start of this one
+				while (offset && doc.text[offset - 1] != '\n')
+					offset--;
+
+				uint32_t from = RANDOM(doc.size);
+				while (from && doc.text[from - 1] != '\n')
+					from--;
+
+				length = ScanLine(doc.text, from, doc.size) - from;
+				length = length > 62 ? 62 : length;
+				memcpy(paste, doc.text + from, length);
+				paste[length++] = '\n';
+				text = paste;
+				break;
+			}
+
+			case 2: { // paste a bit of the text over some of it
+				removed = RANDOM(8);
+				removed = (offset + removed > doc.size) ? 0 : removed;
+				uint32_t from = RANDOM(doc.size);
+				length = RANDOM(8);
+				length = (from + length > doc.size) ? 0 : length;
+				memcpy(paste, doc.text + from, length);
+				text = paste;
+				break;
+			}
+
+			default: { // type or delete a character
+				if (RANDOM(2) && offset < doc.size)
+					removed = 1;
+				else {
+					paste[0] = typed[RANDOM(sizeof(typed) - 1)];
+					// Unknown tokens should not stay around for long
+					if (paste[0] == '@' && RANDOM(8))
+						paste[0] = ' ';
+
+					text = paste;
+					length = 1;
+				}
+			}
+		}
+
+		// Most edits are taken back, and all that break the parse, so the
+		// text stays close to the file
+		char* saved = malloc(removed + 1);
+		memcpy(saved, doc.text + offset, removed);
+
+		DocumentChange change;
+		err = EditDocument(&doc, offset, removed, text, length, &change);
+		int same = SameDocument(&doc, err);
+		clean += !err;
+
+		if (same && (err || RANDOM(16))) {
+			err = EditDocument(&doc, offset, length, saved, removed, &change);
+			same = SameDocument(&doc, err);
+		}
+
+		free(saved);
+		if (!same) {
+			printf("Edit %d at %u (-%u +%u) went wrong\n", i, offset, 
+					removed, length);
+			DeleteDocument(&doc);
+			return 0;
+		}
+	}
+
+#undef RANDOM
+
+	printf("%d edits checked, %d of them parsed, %u statements at the end\n", 
+			CHECK_EDITS, clean, doc.nstats);
+	DeleteDocument(&doc);
+	return 1;
+}
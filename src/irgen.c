@@ -1,183 +1,208 @@
 #include "operators.h"
 #include "irgenhelpers.h"
+#include "flat-ast.h"
 
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <limits.h>
 
+// What IRGen keeps about a variable, see Symbol.data. id is IR_NO_VALUE 
+// until the variable is assigned
 typedef struct ResourceMetadata {
 	Type* type;
-	IRInst* id;
+	IRValue id;
 } RMD;
 
-#define IRGEN_EVALUATE_SUCCESS ((void*)1)
+// Only a variable that has not been assigned has no value, which is fine
+// for the variable an assignment is to
+static int HasValue(FlatAst* ast, uint32_t node, IRValue* values) {
+	if (values[node] != IR_NO_VALUE)
+		return 1;
 
-static IRInst* GenIRExprRecurse(Vector* IR, Expr* expr, 
-		Vector* symtab, int level) {
-
-	switch (expr->type) {
-		case ET_INT_LITERAL: {
-			IRInst* ret = IRConst(IR, expr->literal->type, expr->literal->number);
-			if (!level)
-				goto clean_exit;
-
-			return ret;
-		}
+	printf("GenIRExpr(): %s is used before it has a value\n", 
+			NameText(ast->idents[ast->args[node]]));
+	return 0;
+}
 
-		case ET_UNARY_OP: {
-			UnaryOp* unop = expr->unop;
-			IRInst* operand = GenIRExprRecurse(IR, unop->operand,
-					symtab, level + 1);
-			
-			IRInst* ret = operand;
-			switch (unop->type) {
-				case OP_UNARY_ADD: break; // A unary add is effectively a nop
-				case OP_UNARY_SUB: {
-					ret = IRNeg(IR, operand, operand->type); break;
-				}
+/* Generates the IR of the nodes [first, root] of an expression in one pass,
+ * as the operands of a node always come before it. values holds the IR of
+ * every node, and is indexed like the nodes. The type of every instruction
+ * is the one sema resolved its node to, see FlatAst.types */
+static int GenIRExpr(IR* ir, FlatAst* ast, uint32_t first, uint32_t root,
+		IRValue* values) {
+
+	for (uint32_t node = first; node <= root; node++) {
+		uint32_t arg = ast->args[node];
+		IRType* type = ast->types[node];
+		IRValue ret = IR_NO_VALUE;
+
+		switch (ast->kinds[node]) {
+			case ET_INT_LITERAL: {
+				IntLiteral* literal = &ast->literals[arg];
+				ret = IRConst(ir, type, literal->number);
+				break;
 			}
 
-			if (!level)
-				goto clean_exit;
-
-			return ret;
-		}
+			case ET_UNARY_OP: {
+				IRValue operand = values[node - 1];
+				if (!HasValue(ast, node - 1, values))
+					return 0;
 
-		case ET_BINARY_OP: {
-			BinaryOp* binop = expr->binop;
-			IRInst* left = GenIRExprRecurse(IR, binop->left, 
-					symtab, level + 1);
-			IRInst* right = GenIRExprRecurse(IR, binop->right, 
-					symtab, level + 1);
-
-			IRInst* ret = NULL;
-			IRType* type = left->type;
-
-			switch (binop->type) {
-				case OP_BINARY_ADD: ret = IRAdd(IR, left, right, type); break;
-				case OP_BINARY_SUB: ret = IRSub(IR, left, right, type); break;
-				case OP_BINARY_MUL: ret = IRMul(IR, left, right, type); break;
-				case OP_BINARY_DIV: ret = IRDiv(IR, left, right, type); break;
-				case OP_BINARY_MOD: ret = IRMod(IR, left, right, type); break;
-				case OP_BINARY_EQUALS: {
-					RMD* saved = NULL;
-					for (uint32_t idx = 0; idx < VectorLength(symtab); idx++) {
-						Symbol* var = Get(symtab, idx);
-						if (var->type != TYPE_VARIABLE)
-							continue;
-
-						RMD* rmd = var->data;
-						if (left == rmd->id) {
-							saved = rmd;
-							break;
-						}
+				ret = operand;
+				switch (ast->ops[node]) {
+					case OP_UNARY_ADD: break; // A unary add is effectively a nop
+					case OP_UNARY_SUB: {
+						ret = IRNeg(ir, operand, type); break;
 					}
-
-					saved->id = right;
-					ret = saved->id;
-					break;
-				}
-				default: {
-					printf("GenIRExprRecurse(); IRGen not implemented for "
-						"expr->binop->type = %d\n", expr->binop->type);
-					return 0;
 				}
+
+				break;
 			}
 
-			if (!level)
-				goto clean_exit;
+			case ET_BINARY_OP: {
+				IRValue left = values[arg];
+				IRValue right = values[node - 1];
+				if (!HasValue(ast, node - 1, values) || 
+						(ast->ops[node] != OP_BINARY_EQUALS && 
+						 !HasValue(ast, arg, values)))
+					return 0;
 
-			return ret;
-		}
+				switch (ast->ops[node]) {
+					case OP_BINARY_ADD: ret = IRAdd(ir, left, right, type); break;
+					case OP_BINARY_SUB: ret = IRSub(ir, left, right, type); break;
+					case OP_BINARY_MUL: ret = IRMul(ir, left, right, type); break;
+					case OP_BINARY_DIV: ret = IRDiv(ir, left, right, type); break;
+					case OP_BINARY_MOD: ret = IRMod(ir, left, right, type); break;
+					case OP_BINARY_EQUALS: {
+						if (ast->kinds[arg] != ET_IDENT) {
+							printf("GenIRExpr(): can only assign to a "
+								"variable\n");
+							return 0;
+						}
 
-		case ET_IDENT: {
-			RMD* rmd = GetVariable(symtab, expr->ident)->data;
-			if (!level)
-				goto clean_exit;
+						RMD* rmd = ast->symbols[ast->args[arg]]->data;
+						rmd->id = right;
+						ret = rmd->id;
+						break;
+					}
+					default: {
+						printf("GenIRExpr(); IRGen not implemented for "
+							"binary op = %d\n", ast->ops[node]);
+						return 0;
+					}
+				}
 
-			return rmd->id;
-		}
+				break;
+			}
 
-		case ET_CAST: {
-			IRInst* target = GenIRExprRecurse(IR, expr->cast->expr, 
-					symtab, level + 1);
-			if (!target)
-				return NULL;
+			case ET_IDENT: {
+				RMD* rmd = ast->symbols[arg]->data;
+				values[node] = rmd->id;
+				continue;
+			}
 
-			IRInst* ret = IRCast(IR, target, expr->cast->target);
+			case ET_CAST: {
+				if (!HasValue(ast, node - 1, values))
+					return 0;
 
-			if (!level)
-				goto clean_exit;
+				ret = IRCast(ir, values[node - 1], type);
+				break;
+			}
 
-			return ret;
+			default: {
+				printf("GenIRExpr(): node kind %d does not "
+					"have IRGen implemented for it\n", ast->kinds[node]);
+				return 0;
+			}
 		}
 
-		default: {
-			printf("IRGenExprRecurse(): expr->type %d does not "
-				"have IRGen implemented for it\n", expr->type);
+		if (ret == IR_NO_VALUE) {
+			printf("GenIRExpr(): Out of memory\n");
 			return 0;
 		}
+
+		values[node] = ret;
 	}
 
-clean_exit:
-	return IRGEN_EVALUATE_SUCCESS;
+	return 1;
 }
 
-static int GenIRExpr(Vector* IR, Expr* expr, Vector* symtab) {
-	return GenIRExprRecurse(IR, expr, symtab, 0) == 
-		IRGEN_EVALUATE_SUCCESS;
+/* Flattens expr onto the end of ast and generates its IR, values is grown
+ * along with the nodes */
+static int GenIRFlatten(IR* ir, FlatAst* ast, Expr* expr, IRValue** values) {
+	uint32_t first = ast->nnodes;
+	uint32_t capacity = ast->max_nodes;
+	uint32_t root = FlattenExpr(ast, expr);
+	if (root == UINT32_MAX)
+		return 0;
+
+	if (!*values || ast->max_nodes != capacity) {
+		IRValue* grown = realloc(*values, ast->max_nodes * sizeof(IRValue));
+		if (!grown)
+			return 0;
+
+		*values = grown;
+	}
+
+	return GenIRExpr(ir, ast, first, root, *values);
 }
 
-static int GenIRVarDecl(Vector* IR, VarDecl* vardecl, 
-		Vector* symtab) {
+// The variable is the one sema declared, see VarDecl.sym
+static int GenIRVarDecl(IR* ir, Arena* arena, VarDecl* vardecl, 
+		FlatAst* ast, IRValue** values) {
 
-	RMD* rmd = malloc(sizeof(RMD));
-	rmd->type = GetType(symtab, vardecl->type);
-	rmd->id = malloc(sizeof(IRInst));
-	rmd->id->type = rmd->type;
+	RMD* rmd = Allocate(arena, sizeof(RMD));
+	if (!rmd) {
+		printf("GenIRVarDecl(): Out of memory\n");
+		return 0;
+	}
 
-	Symbol* var = GetVariable(symtab, vardecl->ident);
-	var->data = rmd;
+	rmd->type = vardecl->sym->utype;
+	rmd->id = IR_NO_VALUE;
+	vardecl->sym->data = rmd;
 
 	if (vardecl->init) 
-		if (!GenIRExpr(IR, vardecl->init, symtab))
+		if (!GenIRFlatten(ir, ast, vardecl->init, values))
 			return 0;
 	
 	return 1; 
 }
 
-Vector* GenIR(Vector* stats, Vector* symtab) {
+// The expressions are flattened into one FlatAst as they are reached
+int GenIR(IR* ir, Vector* stats, Arena* arena) {
 	if (!VectorLength(stats))
-		return NULL;
+		return 0;
 
-	Vector* IR = NewVector();
+	FlatAst ast;
+	IRValue* values = NULL;
+	int ok = 1;
 
-	for (uint32_t idx = 0; idx < VectorLength(stats); idx++) {
+	InitFlatAst(&ast);
+	for (uint32_t idx = 0; ok && idx < VectorLength(stats); idx++) {
 		Statement* st = Get(stats, idx);
 		switch (st->type) {
 			case ST_EXPR: {
-				if (!GenIRExpr(IR, st->expr, symtab))
-					return NULL;
+				ok = GenIRFlatten(ir, &ast, st->expr, &values);
 				break;
 			}
 
 			case ST_VARDECL: {
-				if (!GenIRVarDecl(IR, st->vardecl, symtab))
-					return NULL;
-			
+				ok = GenIRVarDecl(ir, arena, st->vardecl, &ast, &values);
 				break;
 			}
 
 			default: {
 				printf("GenIR(): IR Generation is not implemented "
 					"for st->type = %d\n", st->type);
-				return NULL;
+				ok = 0;
 			}
 		}
 	}
 
-	return IR;
+	free(values);
+	DeleteFlatAst(&ast);
+	return ok;
 }
 
 const char* IR2S[] = {
@@ -185,74 +210,40 @@ const char* IR2S[] = {
 	"constant", "neg", "cast"
 };
 
-void PrintIR(Vector* IR) {
-	uint32_t ctr = 1;
-	for (uint32_t idx = 0; idx < VectorLength(IR); idx++) {
-		IRInst* inst = Get(IR, idx);
-		uint32_t* id = GetIDField(inst);
-		if (!id)
-			continue;
-
-		*id = ctr++;
-	}
+void PrintIR(IR* ir) {
+	for (IRValue value = 0; value < ir->ninsts; value++) {
+		IRInst* inst = IRInstOf(ir, value);
+		const char* type = TypeOfTag(inst->type)->name;
 
-	for (uint32_t idx = 0; idx < VectorLength(IR); idx++) {
-		IRInst* inst = Get(IR, idx);
+		printf("t%u = %s %s ", value + 1, IR2S[inst->code], type);
 		switch (inst->code) {
 			case IR_ADD: 
 			case IR_SUB:
 			case IR_MUL:
 			case IR_DIV:
 			case IR_MODULUS: {
-				IRBinaryOp* op = inst->operands;
-				printf("t%u = ", op->ID);
-				printf("%s ", IR2S[inst->code]);
-				if (inst->type)
-					printf("%s ", inst->type->name);
-
-				printf("t%u, ", *GetIDField(op->left));
-				printf("t%u\n", *GetIDField(op->right));
+				printf("t%u, t%u\n", IROperand(ir, inst, 0) + 1, 
+						IROperand(ir, inst, 1) + 1);
 				break;
 			}
 
 			case IR_CONST: {
-				IRConstant* cts = inst->operands;
-				printf("t%u = ", cts->ID);
-				printf("%s ", IR2S[inst->code]);
-				if (inst->type)
-					printf("%s ", inst->type->name);
-
-				printf("%ld\n", cts->target);
-				break;
-			}
-
-			case IR_NEG: {
-				IRNegate* neg = inst->operands;
-				printf("t%u = ", neg->ID);
-				printf("%s ", IR2S[inst->code]);
-				if (inst->type)
-					printf("%s ", inst->type->name);
-
-				printf("t%u\n", *GetIDField(neg->target));
+				PrintLiteral(TypeOfTag(inst->type), ir->consts[inst->args[0]]);
+				printf("\n");
 				break;
 			}
 
+			case IR_NEG:
 			case IR_CAST: {
-				IRCastType* cast = inst->operands;
-				printf("t%u = ", cast->ID);
-				printf("%s ", IR2S[inst->code]);
-				printf("%s ", inst->type->name);
-
-				printf("t%u\n", *GetIDField(cast->target));
+				printf("t%u\n", IROperand(ir, inst, 0) + 1);
 				break;
 			}
 
 			default: {
-				printf("PrintIR(): Printing IR is not implemented "
+				printf("\nPrintIR(): Printing IR is not implemented "
 					"for inst->code = %d\n", inst->code);
 				break;
 			}
 		}
 	}
 }
-
@@ -1,108 +1,209 @@
 #include "irgenhelpers.h"
 #include <stdlib.h>
+#include <string.h>
 
-static IRInst* MakeIRInst(enum IRInstruction inst) {
-	IRInst* ret = malloc(sizeof(IRInst));
-	if (!ret)
-		return NULL;
+void InitIR(IR* ir) {
+	memset(ir, 0, sizeof(IR));
+}
 
-	ret->code = inst;
-	return ret;
+void DeleteIR(IR* ir) {
+	free(ir->insts);
+	free(ir->consts);
+	free(ir->first_use);
+	free(ir->last_use);
+	free(ir->nuses);
+	free(ir->forward);
+	free(ir->next_use);
+	InitIR(ir);
 }
 
-IRInst* IRConst(Vector* IR, IRType* type, int64_t n) {
-	IRInst* ret = MakeIRInst(IR_CONST);
-	IRConstant* ct = malloc(sizeof(IRConstant));
-	ret->type = type;
-	ct->target = n;
+// Doubles the capacity of an array, which starts out with room for 64
+static int Grow(void** array, size_t size, uint32_t* capacity) {
+	uint32_t count = (*capacity) ? *capacity * 2 : 64;
+	void* grown = realloc(*array, count * size);
+	if (!grown)
+		return 0;
+
+	*array = grown;
+	*capacity = count;
+	return 1;
+}
 
-	ret->operands = ct;
-	Append(IR, ret);
+static int GrowInsts(IR* ir) {
+	// The capacity is only updated once all of the arrays have grown
+	struct { void** array; size_t size; } arrays[] = {
+		{ (void**) &ir->insts, sizeof(IRInst) },
+		{ (void**) &ir->first_use, sizeof(uint32_t) },
+		{ (void**) &ir->last_use, sizeof(uint32_t) },
+		{ (void**) &ir->nuses, sizeof(uint32_t) },
+		{ (void**) &ir->forward, sizeof(IRValue) },
+		{ (void**) &ir->next_use, 2 * sizeof(uint32_t) },
+	};
+
+	uint32_t capacity = 0;
+	for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+		capacity = ir->max_insts;
+		if (!Grow(arrays[i].array, arrays[i].size, &capacity))
+			return 0;
+	}
 
-	return ret;
+	ir->max_insts = capacity;
+	return 1;
 }
 
-static IRInst* IRInitBinaryOp(Vector* IR, enum IRInstruction inst, 
-		IRInst* left, IRInst* right, IRType* type) {
+int IROperands(enum IRInstruction code) {
+	switch (code) {
+		case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+		case IR_MODULUS: return 2;
+		case IR_NEG: case IR_CAST: return 1;
+		default: return 0;
+	}
+}
 
-	IRInst* ret = MakeIRInst(inst);
-	IRBinaryOp* op = malloc(sizeof(IRBinaryOp));
-	ret->type = type;
-	op->left = left;
-	op->right = right;
+// Appends the use to the list of the value it uses
+static void AddUse(IR* ir, IRValue value, uint32_t use) {
+	ir->next_use[use] = IR_NO_USE;
+	if (ir->first_use[value] == IR_NO_USE)
+		ir->first_use[value] = use;
+	else
+		ir->next_use[ir->last_use[value]] = use;
 
-	ret->operands = op;
-	Append(IR, ret);
+	ir->last_use[value] = use;
+	ir->nuses[value]++;
+}
 
-	return ret;
+static IRValue MakeIRInst(IR* ir, enum IRInstruction code, IRType* type,
+		uint32_t arg0, uint32_t arg1) {
+	if (ir->ninsts == ir->max_insts && !GrowInsts(ir))
+		return IR_NO_VALUE;
+
+	IRValue value = ir->ninsts++;
+	IRInst* inst = &ir->insts[value];
+	inst->code = code;
+	inst->type = type->tag;
+	inst->args[0] = arg0;
+	inst->args[1] = arg1;
+
+	ir->first_use[value] = ir->last_use[value] = IR_NO_USE;
+	ir->nuses[value] = 0;
+	ir->forward[value] = IR_NO_VALUE;
+	for (int i = 0; i < IROperands(code); i++)
+		AddUse(ir, IRResolve(ir, inst->args[i]), value * 2 + i);
+
+	return value;
 }
 
-IRInst* IRAdd(Vector* IR, IRInst* left, IRInst* right, IRType* type) {
-	return IRInitBinaryOp(IR, IR_ADD, left, right, type);
+// Follows the links left by ReplaceAllUsesWith(), and points every value
+// on the way straight at the end, so that they are only followed once
+IRValue IRResolve(IR* ir, IRValue value) {
+	IRValue root = value;
+	while (ir->forward[root] != IR_NO_VALUE)
+		root = ir->forward[root];
+
+	while (value != root) {
+		IRValue next = ir->forward[value];
+		ir->forward[value] = root;
+		value = next;
+	}
+
+	return root;
+}
+
+void ReplaceAllUsesWith(IR* ir, IRValue value, IRValue replacement) {
+	value = IRResolve(ir, value);
+	replacement = IRResolve(ir, replacement);
+	if (value == replacement)
+		return;
+
+	if (ir->first_use[value] != IR_NO_USE) {
+		if (ir->first_use[replacement] == IR_NO_USE)
+			ir->first_use[replacement] = ir->first_use[value];
+		else
+			ir->next_use[ir->last_use[replacement]] = ir->first_use[value];
+
+		ir->last_use[replacement] = ir->last_use[value];
+	}
+
+	ir->nuses[replacement] += ir->nuses[value];
+	ir->first_use[value] = ir->last_use[value] = IR_NO_USE;
+	ir->nuses[value] = 0;
+	ir->forward[value] = replacement;
 }
 
+// The list is only linked forward, so the use before it is searched for
+static void RemoveUse(IR* ir, IRValue value, uint32_t use) {
+	uint32_t prev = IR_NO_USE;
+	uint32_t cur = ir->first_use[value];
+	while (cur != IR_NO_USE && cur != use) {
+		prev = cur;
+		cur = ir->next_use[cur];
+	}
+
+	if (cur == IR_NO_USE)
+		return; // taken off already
+
+	if (prev == IR_NO_USE)
+		ir->first_use[value] = ir->next_use[use];
+	else
+		ir->next_use[prev] = ir->next_use[use];
 
-IRInst* IRSub(Vector* IR, IRInst* left, IRInst* right, IRType* type) {
-	return IRInitBinaryOp(IR, IR_SUB, left, right, type);
+	if (ir->last_use[value] == use)
+		ir->last_use[value] = prev;
+
+	ir->next_use[use] = IR_NO_USE;
+	ir->nuses[value]--;
 }
 
-IRInst* IRMul(Vector* IR, IRInst* left, IRInst* right, IRType* type) {
-	return IRInitBinaryOp(IR, IR_MUL, left, right, type);
+void IRRemoveUses(IR* ir, IRValue value) {
+	IRInst* inst = IRInstOf(ir, value);
+	for (int i = 0; i < IROperands(inst->code); i++)
+		RemoveUse(ir, IRResolve(ir, inst->args[i]), value * 2 + i);
 }
 
-IRInst* IRDiv(Vector* IR, IRInst* left, IRInst* right, IRType* type) {
-	return IRInitBinaryOp(IR, IR_DIV, left, right, type);
+void ResolveOperands(IR* ir) {
+	for (IRValue value = 0; value < ir->ninsts; value++) {
+		IRInst* inst = &ir->insts[value];
+		for (int i = 0; i < IROperands(inst->code); i++)
+			inst->args[i] = IRResolve(ir, inst->args[i]);
+	}
 }
 
-IRInst* IRMod(Vector* IR, IRInst* left, IRInst* right, IRType* type) {
-	return IRInitBinaryOp(IR, IR_MODULUS, left, right, type);
+IRValue IRConst(IR* ir, IRType* type, uint64_t n) {
+	if (ir->nconsts == ir->max_consts && !Grow((void**) &ir->consts,
+				sizeof(uint64_t), &ir->max_consts))
+		return IR_NO_VALUE;
+
+	IRValue value = MakeIRInst(ir, IR_CONST, type, ir->nconsts, 0);
+	if (value != IR_NO_VALUE)
+		ir->consts[ir->nconsts++] = n;
+
+	return value;
 }
 
-IRInst* IRNeg(Vector* IR, IRInst* operand, IRType* type) {
-	IRInst* inst = MakeIRInst(IR_NEG);
-	IRNegate* op = malloc(sizeof(IRNegate));
-	inst->type = type;
-	op->target = operand;
+IRValue IRAdd(IR* ir, IRValue left, IRValue right, IRType* type) {
+	return MakeIRInst(ir, IR_ADD, type, left, right);
+}
 
-	inst->operands = op;
-	Append(IR, inst);
-	return inst;
+IRValue IRSub(IR* ir, IRValue left, IRValue right, IRType* type) {
+	return MakeIRInst(ir, IR_SUB, type, left, right);
 }
 
-IRInst* IRCast(Vector* IR, IRInst* operand, IRType* type) {
-	IRInst* inst = MakeIRInst(IR_CAST);
-	IRCastType* op = malloc(sizeof(IRCastType));
-	inst->type = type;
-	op->target = operand;
+IRValue IRMul(IR* ir, IRValue left, IRValue right, IRType* type) {
+	return MakeIRInst(ir, IR_MUL, type, left, right);
+}
 
-	inst->operands = op;
-	Append(IR, inst);
-	return inst;
+IRValue IRDiv(IR* ir, IRValue left, IRValue right, IRType* type) {
+	return MakeIRInst(ir, IR_DIV, type, left, right);
 }
 
-uint32_t* GetIDField(IRInst* inst) {
-	switch (inst->code) {
-		case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
-		case IR_MODULUS: {
-			IRBinaryOp* op = inst->operands;
-			return &op->ID;
-		}
-
-		case IR_CONST: {
-			IRConstant* cts = inst->operands;
-			return &cts->ID;
-		}
-
-		case IR_NEG: {
-			IRNegate* op = inst->operands;
-			return &op->ID;
-		}
-
-		case IR_CAST: {
-			IRCastType* cast = inst->operands;
-			return &cast->ID;
-		}
-		default: return NULL;
-	}
+IRValue IRMod(IR* ir, IRValue left, IRValue right, IRType* type) {
+	return MakeIRInst(ir, IR_MODULUS, type, left, right);
 }
 
+IRValue IRNeg(IR* ir, IRValue operand, IRType* type) {
+	return MakeIRInst(ir, IR_NEG, type, operand, 0);
+}
+
+IRValue IRCast(IR* ir, IRValue operand, IRType* type) {
+	return MakeIRInst(ir, IR_CAST, type, operand, 0);
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer-private.h"
+#include "scan.h"
+
+/* A table driven lexer, built from the token spec in tokens.def.
+ *
+ * Every byte of the source is mapped to a character class, and the class 
+ * of the first byte of a token picks the state that scans it, through a 
+ * computed goto. Whitespace, numbers and identifiers loop in a state for
+ * as long as the table of that state says the next byte stays in it. A
+ * byte outside of ASCII leaves the word state for IdentCodePoint(), and
+ * comes back to it if identifiers can have that code point, the tables 
+ * are per byte and not per UTF-8 sequence. Punctuation that can be the 
+ * start of a longer token enters a state, and the transition table for 
+ * (state, next byte) tells us which longer token, if any, it is. Keywords
+ * are told apart from identifiers by the same perfect hash Lex() uses.
+ * This is meant to produce exactly the same tokens as Lex() in lexer.c, 
+ * see CompareLexers() */
+
+enum CharClass {
+	CLS_INVALID, // not allowed outside of comments
+	CLS_SPACE,
+	CLS_DIGIT,
+	CLS_ALPHA,
+	CLS_HIGH,  // the first byte of a UTF-8 sequence of two or more
+	CLS_PUNCT,
+	CLS_MAX
+};
+
+// Transitions to these are not tokens
+#define TT_NONE    TT_MAX
+#define TT_COMMENT (TT_MAX + 1)
+
+// State 0 is the start state, the others are entered after a PUNCT 
+#define DFA_MAX_STATES 16
+
+// The states that loop over a run of bytes, see stays[]
+enum RunState {
+	RUN_SPACE,
+	RUN_WORD, // numbers and identifiers, the parser checks the numbers
+	RUN_MAX
+};
+
+static uint8_t char_class[256];
+static uint8_t punct_token[256];  // TokenType of a PUNCT character
+static uint8_t punct_state[256];  // the state a PUNCT character enters, or 0
+static uint8_t transitions[DFA_MAX_STATES][256];
+static uint8_t stays[RUN_MAX][256]; // 1 if the byte stays in the state
+
+static uint8_t StateOf(uint8_t c, int* nstates) {
+	if (!punct_state[c]) {
+		if (*nstates >= DFA_MAX_STATES) {
+			printf("InitDFA(): too many states, raise DFA_MAX_STATES\n");
+			exit(1);
+		}
+
+		punct_state[c] = (*nstates)++;
+		memset(transitions[punct_state[c]], TT_NONE, 256);
+	}
+
+	return punct_state[c];
+}
+
+// Called once, see InitLexerState()
+void InitDFA() {
+	int nstates = 1;
+	for (int c = 0; c < 256; c++) {
+		if (CHAR_CLASS[c] & CC_SPACE)
+			char_class[c] = CLS_SPACE;
+		else if (CHAR_CLASS[c] & CC_DIGIT)
+			char_class[c] = CLS_DIGIT;
+		else if (CHAR_CLASS[c] & CC_ALPHA)
+			char_class[c] = CLS_ALPHA;
+		else if (IsHigh(c))
+			char_class[c] = CLS_HIGH;
+
+		stays[RUN_SPACE][c] = char_class[c] == CLS_SPACE;
+		stays[RUN_WORD][c] = char_class[c] == CLS_DIGIT || 
+			char_class[c] == CLS_ALPHA;
+	}
+
+#define PUNCT(type, desc, c) \
+	char_class[(uint8_t) c] = CLS_PUNCT; \
+	punct_token[(uint8_t) c] = type;
+#define PUNCT2(type, desc, c1, c2) \
+	transitions[StateOf(c1, &nstates)][(uint8_t) c2] = type;
+#define SKIP2(c1, c2) \
+	transitions[StateOf(c1, &nstates)][(uint8_t) c2] = TT_COMMENT;
+#include "tokens.def"
+}
+
+// Where the run of state that begins at the offset of the lexer ends
+static inline uint32_t Run(Lexer* lexer, enum RunState state) {
+	const char* source = lexer->source;
+	uint32_t offset = lexer->offset;
+	uint32_t len;
+
+	while (offset < lexer->size) {
+		uint8_t c = source[offset];
+		if (stays[state][c])
+			offset++;
+		else if (state == RUN_WORD && char_class[c] == CLS_HIGH && 
+				(len = IdentCodePoint(source + offset)))
+			offset += len;
+		else
+			break;
+	}
+
+	return offset;
+}
+
+Token* LexDFA(Lexer* lexer, Token* token) {
+	static void* const actions[CLS_MAX] = {
+		[CLS_INVALID] = &&invalid,
+		[CLS_SPACE]   = &&space,
+		[CLS_DIGIT]   = &&digit,
+		[CLS_ALPHA]   = &&alpha,
+		[CLS_HIGH]    = &&alpha,
+		[CLS_PUNCT]   = &&punct
+	};
+
+	uint8_t c;
+
+#define DISPATCH() do {                          \
+		if (IsEOF(lexer))                        \
+			goto eof;                            \
+		c = lexer->source[lexer->offset];        \
+		goto *actions[char_class[c]];            \
+	} while (0)
+
+	DISPATCH();
+
+space:
+	// A streaming lexer refills its window at eof
+	lexer->offset = Run(lexer, RUN_SPACE);
+	DISPATCH();
+
+digit:
+	return MakeNumber(lexer, token, Run(lexer, RUN_WORD));
+
+alpha:
+	return MakeIdentOrKeyword(lexer, token, Run(lexer, RUN_WORD));
+
+punct: {
+	uint8_t state = punct_state[c];
+	if (state && lexer->offset + 1 < lexer->size) {
+		uint8_t next = lexer->source[lexer->offset + 1];
+		uint8_t type = transitions[state][next];
+
+		if (type == TT_COMMENT) {
+			SkipLine(lexer);
+			DISPATCH();
+		}
+
+		if (type != TT_NONE)
+			return makeToken(lexer, token, type, 2);
+	}
+
+	return makeToken(lexer, token, punct_token[c], 1);
+}
+
+eof:
+	// A streaming lexer may only be at the end of its window
+	if ((lexer->flags & LEXER_STREAM) && FillWindow(lexer))
+		DISPATCH();
+
+	return makeToken(lexer, token, TT_EOF, 0);
+
+invalid:
+	UnknownToken(lexer);
+
+#undef DISPATCH
+}
+
+static int LexFile(const char* name, Lexer* lexer, uint32_t flags) {
+	if (NewLexer(name, lexer))
+		return 0;
+
+	lexer->flags |= flags;
+	return LexAll(lexer) == SUCCESS;
+}
+
+// Lexes the file with both lexers and checks that they agree on every 
+// token. Returns 1 if they do
+int CompareLexers(const char* name) {
+	Lexer hand, dfa;
+	if (!LexFile(name, &hand, 0) || !LexFile(name, &dfa, LEXER_DFA)) {
+		printf("%s: could not lex file\n", name);
+		return 0;
+	}
+
+	int same = 1;
+	if (hand.ntokens != dfa.ntokens) {
+		printf("%s: %u tokens from Lex(), %u from LexDFA()\n", name, 
+				hand.ntokens, dfa.ntokens);
+		same = 0;
+	}
+
+	uint32_t n = (hand.ntokens < dfa.ntokens) ? hand.ntokens : dfa.ntokens;
+	for (uint32_t i = 0; i < n && same; i++) {
+		Token* h = &hand.tokens[i];
+		Token* d = &dfa.tokens[i];
+		if (h->type != d->type || h->offset != d->offset || 
+				h->length != d->length) {
+			printf("%s: token %u differs, Lex() = { type = %d, "
+				"offset = %u, length = %u }, LexDFA() = { type = %d, "
+				"offset = %u, length = %u }\n", name, i, 
+				h->type, h->offset, h->length,
+				d->type, d->offset, d->length);
+			same = 0;
+		}
+	}
+
+	DeleteLexer(&hand);
+	DeleteLexer(&dfa);
+	return same;
+}
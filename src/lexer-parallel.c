@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "lexer.h"
+#include "scan.h"
+#include "lexer-private.h"
+
+/* Lexes one large file on several threads. The file is cut into chunks
+ * that each begin at the start of a line, and every chunk is lexed by its
+ * own copy of the lexer into its own token array. The arrays are then 
+ * joined in order, dropping the TT_EOF that ends every chunk but the last.
+ *
+ * The only state that carries over from one token to the next is being 
+ * inside a // comment, and a comment always ends at the '\n' before the 
+ * start of a chunk, so the guess that a chunk starts outside a comment is
+ * never wrong. No token spans a newline either, so every token lies in 
+ * exactly one chunk. Tokens keep their offsets in the whole file, and line
+ * numbers are computed from those, just as they are for a single thread. 
+ *
+ * A chunk that runs into an unknown token gives up, the tokens of every 
+ * chunk are thrown away, and LexAll() lexes the whole file again from the
+ * start on one thread, so that the error is reported exactly like it would
+ * be without threads. Bad input is rare enough not to bother keeping the 
+ * chunks before the one that failed */
+
+#define LEXER_CHUNK_MIN (256 * 1024) // smaller files are not worth a thread
+#define LEXER_THREADS_MAX 64
+
+typedef struct Chunk {
+	Lexer    lexer;   // a copy of the lexer over the chunk
+	Token*   tokens;
+	uint32_t ntokens;
+	LexerError err;
+	pthread_t thread;
+} Chunk;
+
+static void* LexChunk(void* arg) {
+	Chunk* chunk = arg;
+	jmp_buf bail;
+
+	if (setjmp(bail)) {
+		free(chunk->tokens);
+		chunk->tokens = NULL;
+		chunk->err = CHUNK_FAILED;
+		return NULL;
+	}
+
+	chunk->lexer.bail = &bail;
+	chunk->err = LexRange(&chunk->lexer, &chunk->tokens, &chunk->ntokens);
+	return NULL;
+}
+
+static uint32_t Threads(Lexer* lexer) {
+	uint32_t threads = lexer->threads;
+	if (!threads) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 0 ? cores : 1;
+	}
+
+	if (threads > lexer->size / LEXER_CHUNK_MIN)
+		threads = lexer->size / LEXER_CHUNK_MIN;
+
+	return threads > LEXER_THREADS_MAX ? LEXER_THREADS_MAX : threads;
+}
+
+static void InitChunk(Lexer* lexer, Chunk* chunk, uint32_t start, 
+		uint32_t end) {
+	chunk->lexer = *lexer;
+	chunk->lexer.source = lexer->source + start;
+	chunk->lexer.size = end - start;
+	chunk->lexer.base = start;
+	chunk->lexer.offset = 0;
+	chunk->lexer.lines = NULL;
+	chunk->lexer.nlines = 0;
+	chunk->lexer.tokens = NULL;
+	chunk->lexer.peek = NULL;
+	chunk->tokens = NULL;
+	chunk->ntokens = 0;
+	chunk->err = SUCCESS;
+}
+
+/* Returns CHUNK_FAILED when the file is too small to split, or when one of 
+ * the chunks found an unknown token, and the caller has to lex it alone */
+LexerError LexParallel(Lexer* lexer, Token** out, uint32_t* count) {
+	uint32_t threads = Threads(lexer);
+	if (threads < 2 || lexer->offset)
+		return CHUNK_FAILED;
+
+	Chunk* chunks = calloc(threads, sizeof(Chunk));
+	if (!chunks)
+		return OUT_OF_MEMORY;
+
+	// Move every cut forward to just after the next newline
+	uint32_t start = 0, nchunks = 0;
+	for (uint32_t i = 0; i < threads && start < lexer->size; i++) {
+		uint32_t end = lexer->size;
+		if (i + 1 < threads) {
+			uint64_t cut = (uint64_t) lexer->size * (i + 1) / threads;
+			end = cut < start ? start : cut;
+			end = ScanLine(lexer->source, end, lexer->size);
+			end = end < lexer->size ? end + 1 : end;
+		}
+
+		InitChunk(lexer, &chunks[nchunks++], start, end);
+		start = end;
+	}
+
+	uint32_t spawned = 1;
+	for (; spawned < nchunks; spawned++) {
+		Chunk* chunk = &chunks[spawned];
+		if (pthread_create(&chunk->thread, NULL, LexChunk, chunk))
+			break;
+	}
+
+	// This thread takes the first chunk, along with any that could not get
+	// a thread of their own
+	LexChunk(&chunks[0]);
+	for (uint32_t i = spawned; i < nchunks; i++)
+		LexChunk(&chunks[i]);
+
+	for (uint32_t i = 1; i < spawned; i++)
+		pthread_join(chunks[i].thread, NULL);
+
+	LexerError err = SUCCESS;
+	uint32_t total = 1;
+	for (uint32_t i = 0; i < nchunks; i++) {
+		if (chunks[i].err && !err)
+			err = chunks[i].err;
+
+		total += chunks[i].ntokens - 1;
+	}
+
+	Token* tokens = NULL;
+	if (!err) {
+		tokens = malloc(sizeof(Token) * total);
+		if (!tokens)
+			err = OUT_OF_MEMORY;
+	}
+
+	uint32_t ntokens = 0;
+	for (uint32_t i = 0; i < nchunks; i++) {
+		// Every chunk ends in a TT_EOF, only the last one is kept
+		uint32_t n = chunks[i].ntokens - (i + 1 < nchunks);
+		if (tokens)
+			memcpy(tokens + ntokens, chunks[i].tokens, sizeof(Token) * n);
+
+		ntokens += n;
+		free(chunks[i].tokens);
+	}
+
+	free(chunks);
+	if (err)
+		return err;
+
+	*out = tokens;
+	*count = ntokens;
+	return SUCCESS;
+}
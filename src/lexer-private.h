@@ -0,0 +1,27 @@
+#ifndef __LEXER_PRIVATE_H__
+#define __LEXER_PRIVATE_H__
+
+#include "lexer.h"
+
+/* Shared between the hand written lexer in lexer.c and the table driven 
+ * one in lexer-dfa.c, so that both produce exactly the same tokens, and 
+ * with lexer-parallel.c which runs either of them over chunks of a file */
+
+Token* makeToken(Lexer* lexer, Token* token, TokenType type, uint32_t length);
+int IsEOF(Lexer* lexer);
+void Advance(Lexer* lexer, uint32_t len);
+void SkipLine(Lexer* lexer);
+int FillWindow(Lexer* lexer);
+uint32_t IdentCodePoint(const char* s);
+Token* MakeIdentOrKeyword(Lexer* lexer, Token* token, uint32_t end);
+Token* MakeNumber(Lexer* lexer, Token* token, uint32_t end);
+_Noreturn void UnknownToken(Lexer* lexer);
+void ValidateSource(Lexer* lexer);
+LexerError LexRange(Lexer* lexer, Token** out, uint32_t* count);
+
+void InitDFA();
+Token* LexDFA(Lexer* lexer, Token* token);
+
+LexerError LexParallel(Lexer* lexer, Token** out, uint32_t* count);
+
+#endif
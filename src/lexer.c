@@ -3,32 +3,70 @@
 #include <stdint.h>
 #include <string.h>
 #include <limits.h>
-#include <ctype.h>
 #include <assert.h>
+#include <pthread.h>
 
 #if defined(__linux__) || defined(__ANDROID__)
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "lexer.h"
+#include "names.h"
+#include "scan.h"
+#include "lexer-private.h"
 
 static _Noreturn void die(const char* msg) {
 	printf("%s\n", msg);
 	exit(1);
 }
 
-static LineExtent* makeLE(uint32_t line, uint32_t offset) {
-	LineExtent* ret = malloc(sizeof(LineExtent));
-	if (!ret)
-		return NULL;
+// The tables of both lexers and the scan kernels are the same for every 
+// lexer, they are set up by the first one on any thread
+static void InitTables() {
+	InitScanner();
+	InitDFA();
+}
 
-	ret->line = line;
-	ret->offset = offset;
-	ret->length = 0;
+static void InitLexerState(Lexer* lexer) {
+	static pthread_once_t tables = PTHREAD_ONCE_INIT;
 
-	return ret;
+	lexer->offset = 0;
+	lexer->base = 0;
+	lexer->base_line = 0;
+	lexer->keep = 0;
+	lexer->peek = NULL;
+	lexer->flags = 0;
+	lexer->tokens = NULL;
+	lexer->ntokens = 0;
+	lexer->cursor = 0;
+	lexer->lines = NULL;
+	lexer->nlines = 0;
+	lexer->fd = -1;
+	lexer->filled = 0;
+	lexer->capacity = 0;
+	lexer->past = NULL;
+	lexer->npast = 0;
+	lexer->past_text = NULL;
+	lexer->threads = 0;
+	lexer->bail = NULL;
+	lexer->pool = NULL;
+	lexer->arena = NULL;
+	InitArena(&lexer->token_arena, 0);
+
+	pthread_once(&tables, InitTables);
+}
+
+static LexerError SetFileName(Lexer* lexer, const char* name, int len) {
+	lexer->file = malloc((len + 1) * sizeof(char));
+	if (!lexer->file)
+		return OUT_OF_MEMORY;
+
+	memcpy(lexer->file, name, len);
+	lexer->file[len] ='\0';
+	return SUCCESS;
 }
 
 LexerError NewLexer(const char* name, Lexer* lexer) {
@@ -39,12 +77,21 @@ LexerError NewLexer(const char* name, Lexer* lexer) {
 	if (len > PATH_MAX || !len)
 		return INVALID_PATH;
 
+	if (strcmp(name, "-") == 0)
+		return NewStreamLexer(name, lexer);
+
+	InitLexerState(lexer);
+
 #if defined(__linux__) || defined(__ANDROID__)
 	struct stat st;
 	if (stat(name, &st) < 0)
 		return FILE_NOT_FOUND;
 
-	if (st.st_size > (1 << 20))
+	// Pipes and the like can't be mapped, we read them a window at a time
+	if (!S_ISREG(st.st_mode))
+		return NewStreamLexer(name, lexer);
+
+	if (st.st_size > UINT32_MAX)
 		return FILE_TOO_LONG;
 
 	if (!st.st_size)
@@ -55,36 +102,95 @@ LexerError NewLexer(const char* name, Lexer* lexer) {
 		return FILE_NOT_ACCESSIBLE;
 
 	lexer->source = mmap(NULL, 	st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
 	if (lexer->source == MAP_FAILED)
 		return FILE_MAP_FAILED;
 
 	lexer->size = st.st_size;
 #endif
 
-	lexer->file = malloc((len + 1) * sizeof(char));
-	if (!lexer->file)
-		return OUT_OF_MEMORY;
+	return SetFileName(lexer, name, len);
+}
 
-	lexer->offset = 0;
-	lexer->line = 1;
-	lexer->pos = 1;
-	lexer->peek = NULL;
-	lexer->flags = 0;
-	lexer->extent = NewVector();
+LexerError NewStreamLexer(const char* name, Lexer* lexer) {
+	if (!name || !lexer)
+		return REQUIRED_PARAM_NULL;
 
-	Append(lexer->extent, makeLE(1, 0));
+	int len = strlen(name);
+	if (len > PATH_MAX || !len)
+		return INVALID_PATH;
 
-	memcpy(lexer->file, name, len);
-	lexer->file[len] ='\0';
+	InitLexerState(lexer);
+	lexer->flags |= LEXER_STREAM;
+
+	if (strcmp(name, "-") == 0) {
+		lexer->fd = STDIN_FILENO;
+		name = "<stdin>";
+		len = strlen(name);
+	} else {
+		lexer->fd = open(name, O_RDONLY);
+		if (lexer->fd < 0)
+			return FILE_NOT_ACCESSIBLE;
+	}
+
+	lexer->capacity = LEXER_WINDOW;
+	lexer->source = malloc(lexer->capacity);
+	if (!lexer->source)
+		return OUT_OF_MEMORY;
+
+	lexer->size = 0;
+	LexerError err = SetFileName(lexer, name, len);
+	if (err)
+		return err;
+
+	if (!FillWindow(lexer))
+		return EMPTY_FILE;
 
 	return SUCCESS;
 }
 
+/* A lexer over text that is already in memory, which the caller owns and 
+ * may change, as long as it updates Lexer.source and Lexer.size after. 
+ * Used for documents that are being edited, see incremental.c */
+LexerError NewBufferLexer(const char* name, char* text, uint32_t size, 
+		Lexer* lexer) {
+	if (!name || !lexer || (!text && size))
+		return REQUIRED_PARAM_NULL;
+
+	int len = strlen(name);
+	if (len > PATH_MAX || !len)
+		return INVALID_PATH;
+
+	InitLexerState(lexer);
+	lexer->flags |= LEXER_BUFFER;
+	lexer->source = text;
+	lexer->size = size;
+
+	return SetFileName(lexer, name, len);
+}
+
 LexerError DeleteLexer(Lexer* lexer) {
 	if (!lexer)
 		return REQUIRED_PARAM_NULL;
 
 	free(lexer->file);
+	free(lexer->tokens);
+	free(lexer->lines);
+	free(lexer->past);
+	free(lexer->past_text);
+	DeleteArena(&lexer->token_arena);
+
+	if (lexer->flags & LEXER_BUFFER)
+		return SUCCESS;
+
+	if (lexer->flags & LEXER_STREAM) {
+		free(lexer->source);
+		if (lexer->fd != STDIN_FILENO && close(lexer->fd) < 0)
+			return RESOURCE_CLEANUP_FAILED;
+
+		return SUCCESS;
+	}
+
 #if defined(__linux__) || defined(__ANDROID__)
 	lexer->size -= lexer->size % 4096;
 	lexer->size += 4096;
@@ -96,85 +202,204 @@ LexerError DeleteLexer(Lexer* lexer) {
 	return SUCCESS;
 }
 
-static Token* makeToken(Lexer* lexer, TokenType type, uint32_t length) {
-	Token* token = malloc(sizeof(Token));
-	if (!token)
-		die("makeToken(): malloc() == NULL");
+static uint32_t CountLines(const char* source, uint32_t offset, 
+		uint32_t size) {
+	uint32_t count = 0;
+	while ((offset = ScanLine(source, offset, size)) < size) {
+		count++;
+		offset++;
+	}
 
-	token->type = type;
-	token->line = lexer->line;
-	token->pos = lexer->pos;
-	token->offset = lexer->offset;
-	token->length = length;
+	return count;
+}
+
+/* Moves the window of a streaming lexer forward, once everything in it has
+ * been lexed. The window always ends just after a '\n' (or at the end of 
+ * the input), and since no token spans a newline, no token ever straddles
+ * two windows. Text is only dropped from the front of the window once the
+ * buffer is full, and then only up to the line holding Lexer.keep, so the
+ * tokens of the statement being parsed can still be read. Where the lines
+ * that are dropped begin is kept in Lexer.past, for LexerLocate().
+ * A statement or line longer than the window grows it.
+ * Returns 0 at the end of the input */
+int FillWindow(Lexer* lexer) {
+	uint32_t discard = 0;
+	if (lexer->filled == lexer->capacity) {
+		discard = lexer->size;
+		if (lexer->keep >= lexer->base && 
+				lexer->keep - lexer->base < discard) {
+			discard = lexer->keep - lexer->base;
+			while (discard && lexer->source[discard - 1] != '\n')
+				discard--;
+		}
+	}
+
+	if ((uint64_t) lexer->base + lexer->filled > UINT32_MAX)
+		die("FillWindow(): input is larger than 4GB");
+
+	// The window always begins at the start of a line
+	for (uint32_t start = 0; start < discard;) {
+		uint32_t n = lexer->npast;
+		if (!(n & (n - 1))) {
+			lexer->past = realloc(lexer->past, 
+					sizeof(uint32_t) * (n ? n * 2 : 1));
+			if (!lexer->past)
+				die("FillWindow(): realloc() == NULL");
+		}
+
+		lexer->past[lexer->npast++] = lexer->base + start;
+		start = ScanLine(lexer->source, start, discard) + 1;
+	}
+
+	lexer->base_line += CountLines(lexer->source, 0, discard);
+	lexer->base += discard;
+	lexer->filled -= discard;
+	memmove(lexer->source, lexer->source + discard, lexer->filled);
+	lexer->offset = lexer->size - discard;
+	lexer->size = lexer->offset;
+
+	// The line index is relative to the start of the window
+	free(lexer->lines);
+	lexer->lines = NULL;
+	lexer->nlines = 0;
+
+	uint32_t scanned = lexer->size;
+	int eof = 0;
+	while (1) {
+		uint32_t nl = ScanLine(lexer->source, scanned, lexer->filled);
+		if (nl < lexer->filled) {
+			// Everything up to the last complete line goes in this window
+			lexer->size = nl + 1;
+			while ((nl = ScanLine(lexer->source, lexer->size, lexer->filled))
+					< lexer->filled)
+				lexer->size = nl + 1;
+
+			break;
+		}
+
+		scanned = lexer->filled;
+		if (eof) {
+			lexer->size = lexer->filled;
+			break;
+		}
+
+		if (lexer->filled == lexer->capacity) {
+			lexer->capacity *= 2;
+			lexer->source = realloc(lexer->source, lexer->capacity);
+			if (!lexer->source)
+				die("FillWindow(): realloc() == NULL");
+		}
 
-	if (length > 0) {
-		lexer->pos += length;
-		lexer->offset += length;
+		ssize_t got = read(lexer->fd, lexer->source + lexer->filled, 
+				lexer->capacity - lexer->filled);
+		if (got < 0)
+			die("FillWindow(): read() failed");
+
+		if (!got)
+			eof = 1;
+
+		lexer->filled += got;
 	}
 
+	ValidateSource(lexer);
+	return lexer->offset < lexer->size;
+}
+
+Token* makeToken(Lexer* lexer, Token* token, TokenType type, 
+		uint32_t length) {
+	token->type = type;
+	token->offset = lexer->base + lexer->offset;
+	token->length = length;
+	token->hash = 0;
+	lexer->offset += length;
+
 	return token;
 }
 
-static int IsEOF(Lexer* lexer) {
+int IsEOF(Lexer* lexer) {
 	return lexer->offset >= lexer->size;
 }
 
-static void SkipSpace(Lexer* lexer) {
-	while (!IsEOF(lexer)) {
-		char c = lexer->source[lexer->offset];
-		if (isspace(c)) {
-			switch (c) {
-				case '\r' : case '\f' :
-				case ' '  : lexer->pos++; break;
-				case '\n' : {
-					LineExtent* line = Get(lexer->extent, lexer->line - 1);
-					line->length = lexer->offset - line->offset;
-
-					lexer->line++; 
-					lexer->pos = 1; 
-					Append(lexer->extent, makeLE(lexer->line, lexer->offset + 1));
-					break;
-				}
-				case '\t' : {
-					// Assume that tab stop is 8 spaces
-					lexer->pos -= lexer->pos % 8;
-					lexer->pos += 8;
-					break;
-				}
-				case '\v' : lexer->line++; break;
-				default: {} // unreachable
-			}
+// Moves the lexer over len bytes
+void Advance(Lexer* lexer, uint32_t len) {
+	lexer->offset += len;
+}
 
-		} else 
+static void SkipSpace(Lexer* lexer) {
+	while (1) {
+		lexer->offset = ScanSpace(lexer->source, lexer->offset, lexer->size);
+		if (!IsEOF(lexer) || !(lexer->flags & LEXER_STREAM))
 			return;
 
-		lexer->offset++;
+		if (!FillWindow(lexer))
+			return;
 	}
 }
 
 /* The length of keywords, klen and kmap, must be equal */
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
-// List of all keywords
-static const char* keywords[] = {
-	"let", "function", NULL
-};
+/* keywords[], klen[] and kmap[] are generated from include/keywords.def 
+ * by tools/genkeywords.c as a perfect hash table of KEYWORD_TABLE_SIZE 
+ * slots, indexed by KEYWORD_HASH(length, first char, last char).
+ * For a keyword in slot i:
+ * klen[i] = strlen(keywords[i]), kmap[i] = TokenType(keywords[i])
+ * and empty slots have klen[i] = 0, so they never match */
+#include "keywords.inc"
+
+/* Identifiers are made of ASCII letters and digits, and of any code point
+ * outside of ASCII other than the C1 controls and whitespace. Returns the
+ * length of the sequence at s if it is one of those, or 0. The source has
+ * been validated, so the sequence is well formed */
+uint32_t IdentCodePoint(const char* s) {
+	const uint8_t* u = (const uint8_t*) s;
+	uint32_t cp, len;
+	if (u[0] < 0xe0) {
+		cp = ((u[0] & 0x1f) << 6) | (u[1] & 0x3f);
+		len = 2;
+	} else if (u[0] < 0xf0) {
+		cp = ((u[0] & 0x0f) << 12) | ((u[1] & 0x3f) << 6) | (u[2] & 0x3f);
+		len = 3;
+	} else
+		return 4; // nothing past U+FFFF is excluded
+
+	// U+0080-U+009F are controls, U+00A0 is a no-break space
+	if (cp <= 0xa0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200a) ||
+			cp == 0x2028 || cp == 0x2029 || cp == 0x202f || cp == 0x205f ||
+			cp == 0x3000 || cp == 0xfeff)
+		return 0;
 
-int lkeywords = ARRAY_SIZE(keywords);
+	return len;
+}
 
-/* Lengths of all keywords, indexed by their position
- * in keywords[] i.e klen[i] = strlen(keywords[i]) */
-static int klen[] = {
-	3, 8, 0
-};
+// Carries on with an identifier that has a byte outside of ASCII at offset
+static uint32_t ScanIdentUTF8(Lexer* lexer, uint32_t offset) {
+	while (offset < lexer->size && IsHigh(lexer->source[offset])) {
+		uint32_t len = IdentCodePoint(lexer->source + offset);
+		if (!len)
+			break;
 
-/* What token type each keyword in keywords[] maps to
- * i.e kmap[i] = TokenType(keywords[i]) */
-static TokenType kmap[] = {
-	TT_LET, TT_FUNCTION, 0 
-};
+		offset = ScanAlnum(lexer->source, offset + len, lexer->size);
+	}
 
-static Token* ReadIdentOrKeyword(Lexer* lexer) {
+	return offset;
+}
+
+/* Scans the letters and digits from offset on. Almost every identifier is
+ * ASCII, which ScanAlnum() deals with, and we only decode when it stops at
+ * a byte with the high bit set */
+static inline uint32_t ScanIdent(Lexer* lexer, uint32_t offset) {
+	offset = ScanAlnum(lexer->source, offset, lexer->size);
+	if (offset < lexer->size && IsHigh(lexer->source[offset]))
+		return ScanIdentUTF8(lexer, offset);
+
+	return offset;
+}
+
+/* Makes the identifier or keyword from the offset of the lexer up to end, 
+ * where the scan of its letters and digits stopped. Shared with LexDFA(),
+ * which scans them through its own tables */
+Token* MakeIdentOrKeyword(Lexer* lexer, Token* token, uint32_t end) {
 	// Make sure these hold or we will fail at run-time catastrophically
 	_Static_assert(ARRAY_SIZE(keywords) == ARRAY_SIZE(klen), 
 			"len(keywords) != len(klen)");
@@ -184,65 +409,56 @@ static Token* ReadIdentOrKeyword(Lexer* lexer) {
 	// Assume that it's an identifier, if it turns out to be a keyword
 	// we can fix up token->type later on.
 	
-	Token* token = makeToken(lexer, TT_IDENT, 0);
-
-	while (!IsEOF(lexer)) {
-		char c = lexer->source[lexer->offset];
-		if (isalnum(c)) {
-			token->length++;
-			lexer->pos++;
-			lexer->offset++;
-		}
-		else 
-			break;
-	}
+	makeToken(lexer, token, TT_IDENT, 0);
 
-	for (int i = 0; i < lkeywords; i++) {
-		if (klen[i] == token->length) {
-			if (strncmp(keywords[i], lexer->source + token->offset, 
-					klen[i]) == 0) {
-				token->type = kmap[i];
-				break;
-			}
-		}
-	}
+	if (end == lexer->offset || end - lexer->offset > TOKEN_MAX_LENGTH)
+		UnknownToken(lexer); // not a code point that identifiers can have
+
+	token->length = end - lexer->offset;
+	Advance(lexer, token->length);
+
+	const char* text = TokenText(lexer, token);
+	uint32_t slot = KEYWORD_HASH(token->length, (uint8_t) text[0], 
+			(uint8_t) text[token->length - 1]);
+
+	if (klen[slot] == token->length 
+			&& memcmp(keywords[slot], text, token->length) == 0)
+		token->type = kmap[slot];
+	else // the bytes were just scanned, so they are still in the cache
+		token->hash = HashName(text, token->length);
 
 	return token;
 }
 
-static Token* ReadNumber(Lexer* lexer) {
-	Token* token = makeToken(lexer, TT_NUMBER, 0);
+static Token* ReadIdentOrKeyword(Lexer* lexer, Token* token) {
+	return MakeIdentOrKeyword(lexer, token, ScanIdent(lexer, lexer->offset));
+}
+
+// Like MakeIdentOrKeyword(), for a number
+Token* MakeNumber(Lexer* lexer, Token* token, uint32_t end) {
+	makeToken(lexer, token, TT_NUMBER, 0);
 
+	if (end - lexer->offset > TOKEN_MAX_LENGTH)
+		UnknownToken(lexer);
+
+	token->length = end - lexer->offset;
+	Advance(lexer, token->length);
+
+	return token;
+}
+
+static Token* ReadNumber(Lexer* lexer, Token* token) {
 	/* The parser will later figure out if this is at all a valid number
 	 * or not, the lexer will consume everything alphanumeric, this allows
 	 * us to offload the burden on figuring out the numeral system 
 	 * (hexadecimal, octal, decimal etc.) onto the parser */
-	
-	while (!IsEOF(lexer)) {
-		char c = lexer->source[lexer->offset];
-		if (isalnum(c)) {
-			token->length++;
-			lexer->pos++;
-			lexer->offset++;
-		}
-		else 
-			break;
-	}
-
-	return token;
+	return MakeNumber(lexer, token, ScanIdent(lexer, lexer->offset));
 }
 
 void SkipLine(Lexer* lexer) {
-	while (!IsEOF(lexer)) {
-		if (lexer->source[lexer->offset] == '\n')
-			break;
-
-		// We don't need to accurately track tabs and positions in the comment
-		// because, errors cannot originate from here. 
-		// The compiler will always ignore everything followed by // 
-		lexer->offset++;
-		lexer->pos++;
-	}
+	// The compiler will always ignore everything followed by // 
+	uint32_t end = ScanLine(lexer->source, lexer->offset, lexer->size);
+	Advance(lexer, end - lexer->offset);
 }
 
 static int LexerPeek(Lexer* lexer) {
@@ -252,63 +468,177 @@ static int LexerPeek(Lexer* lexer) {
 	return lexer->source[lexer->offset + 1];
 }
 
-Token* Next(Lexer* lexer) {
-	if (lexer->peek) {
-		Token* ret = lexer->peek;
-		lexer->peek = NULL;
-		return ret;
-	}
+// Stops at the first byte in source[offset, size) that is not valid UTF-8
+void ValidateSource(Lexer* lexer) {
+	uint32_t bad = ScanUTF8(lexer->source, lexer->offset, lexer->size);
+	if (bad == lexer->size)
+		return;
 
-	if (IsEOF(lexer)) 
-		return makeToken(lexer, TT_EOF, 0);
+	if (lexer->bail)
+		longjmp(*lexer->bail, 1);
 
+	LineInfo li = LexerLocate(lexer, lexer->base + bad);
+	printf("Invalid UTF-8 at %s %u:%u", lexer->file, li.line, li.pos);
+	die("");
+}
+
+_Noreturn void UnknownToken(Lexer* lexer) {
+	// Lexing a chunk of the file on another thread, see lexer-parallel.c
+	if (lexer->bail)
+		longjmp(*lexer->bail, 1);
+
+	LineInfo li = LexerLocate(lexer, lexer->base + lexer->offset);
+	printf("Unknown token at %s %u:%u", lexer->file, li.line, li.pos);
+	die("");
+}
+
+// Scans the next token from the source into token
+static Token* Lex(Lexer* lexer, Token* token) {
 	SkipSpace(lexer);
 
 	if (IsEOF(lexer))
-		return makeToken(lexer, TT_EOF, 0);
+		return makeToken(lexer, token, TT_EOF, 0);
 
 	char c = lexer->source[lexer->offset];
 	switch (c) {
-		case '+' : return makeToken(lexer, TT_PLUS, 1);
+		case '+' : return makeToken(lexer, token, TT_PLUS, 1);
 		case '-' : {
 			int next = LexerPeek(lexer);
 			switch (next) {
-				case '>': return makeToken(lexer, TT_RETURNS, 2);
-				default: return makeToken(lexer, TT_MINUS, 1);
+				case '>': return makeToken(lexer, token, TT_RETURNS, 2);
+				default: return makeToken(lexer, token, TT_MINUS, 1);
 			}
 		}
-		case '*' : return makeToken(lexer, TT_ASTERISK, 1);
+		case '*' : return makeToken(lexer, token, TT_ASTERISK, 1);
 		case '/' : {
 			int next = LexerPeek(lexer);
 			switch (next) {
-				case '/': SkipLine(lexer); return Next(lexer);
-				default: return makeToken(lexer, TT_SLASH, 1);
+				case '/': SkipLine(lexer); return Lex(lexer, token);
+				default: return makeToken(lexer, token, TT_SLASH, 1);
 			}
 		}
 
-		case ';' : return makeToken(lexer, TT_SEMICOLON, 1);
-		case '=' : return makeToken(lexer, TT_EQUALS, 1);
-		case ':' : return makeToken(lexer, TT_COLON, 1);
-		case ',' : return makeToken(lexer, TT_COMMA, 1);
-		case '(' : return makeToken(lexer, TT_LPAREN, 1);
-		case '{' : return makeToken(lexer, TT_LCURLY, 1);
-		case '}' : return makeToken(lexer, TT_RCURLY, 1);
-		case ')' : return makeToken(lexer, TT_RPAREN, 1);
-		case '%' : return makeToken(lexer, TT_PERCENT, 1);
+		case ';' : return makeToken(lexer, token, TT_SEMICOLON, 1);
+		case '=' : return makeToken(lexer, token, TT_EQUALS, 1);
+		case ':' : return makeToken(lexer, token, TT_COLON, 1);
+		case ',' : return makeToken(lexer, token, TT_COMMA, 1);
+		case '(' : return makeToken(lexer, token, TT_LPAREN, 1);
+		case '{' : return makeToken(lexer, token, TT_LCURLY, 1);
+		case '}' : return makeToken(lexer, token, TT_RCURLY, 1);
+		case ')' : return makeToken(lexer, token, TT_RPAREN, 1);
+		case '%' : return makeToken(lexer, token, TT_PERCENT, 1);
 		default: {
-			if (isdigit(c))
-				return ReadNumber(lexer);
+			if (IsDigit(c))
+				return ReadNumber(lexer, token);
 
-			if (isalpha(c))
-				return ReadIdentOrKeyword(lexer);
+			if (IsAlpha(c) || IsHigh(c))
+				return ReadIdentOrKeyword(lexer, token);
 		}
 	}
 
-	printf("Unknown token at %s %u:%u", lexer->file, lexer->line, lexer->pos);
-	die("");
+	UnknownToken(lexer);
+}
+
+/* Lexes everything from Lexer.offset to the end of the source into a new 
+ * array of tokens, which always ends with TT_EOF. out always points to the
+ * array, so that it can be freed when Lexer.bail is taken */
+LexerError LexRange(Lexer* lexer, Token** out, uint32_t* count) {
+	*out = NULL;
+	ValidateSource(lexer);
+
+	// A rough guess of one token for every 4 bytes of source saves us most
+	// of the reallocations on typical code
+	uint32_t capacity = (lexer->size - lexer->offset) / 4 + 16;
+	Token* tokens = malloc(sizeof(Token) * capacity);
+	*out = tokens;
+	if (!tokens)
+		return OUT_OF_MEMORY;
+
+	uint32_t ntokens = 0;
+	while (1) {
+		if (ntokens >= capacity) {
+			capacity *= 2;
+			Token* grown = realloc(tokens, sizeof(Token) * capacity);
+			if (!grown) {
+				free(tokens);
+				*out = NULL;
+				return OUT_OF_MEMORY;
+			}
+
+			tokens = grown;
+			*out = tokens;
+		}
+
+		Token* token = (lexer->flags & LEXER_DFA) 
+			? LexDFA(lexer, &tokens[ntokens++]) : Lex(lexer, &tokens[ntokens++]);
+		if (token->type == TT_EOF)
+			break;
+	}
+
+	*count = ntokens;
+	return SUCCESS;
+}
+
+LexerError LexAll(Lexer* lexer) {
+	if (!lexer)
+		return REQUIRED_PARAM_NULL;
+
+	// The text of the tokens would be gone by the time anyone looks at it
+	if (lexer->flags & LEXER_STREAM)
+		return STREAM_NOT_SUPPORTED;
+
+	Token* tokens = NULL;
+	uint32_t ntokens = 0;
+	LexerError err = LexParallel(lexer, &tokens, &ntokens);
+	if (err == CHUNK_FAILED)
+		err = LexRange(lexer, &tokens, &ntokens);
+
+	if (err)
+		return err;
+
+	lexer->tokens = tokens;
+	lexer->ntokens = ntokens;
+	lexer->cursor = 0;
+	lexer->flags |= LEXER_BATCH;
+
+	return SUCCESS;
+}
+
+Token* Next(Lexer* lexer) {
+	if (lexer->flags & LEXER_BATCH) {
+		Token* ret = &lexer->tokens[lexer->cursor];
+		// The last token is always TT_EOF, and we keep returning it 
+		// once the whole stream has been consumed
+		if (lexer->cursor + 1 < lexer->ntokens)
+			lexer->cursor++;
+
+		return ret;
+	}
+
+	if (lexer->peek) {
+		Token* ret = lexer->peek;
+		lexer->peek = NULL;
+		return ret;
+	}
+
+	// The whole source is checked before the first token, a streaming
+	// lexer checks every window as it reads it
+	if (!(lexer->flags & (LEXER_VALID | LEXER_STREAM))) {
+		ValidateSource(lexer);
+		lexer->flags |= LEXER_VALID;
+	}
+
+	Token* token = ArenaAlloc(&lexer->token_arena, sizeof(Token));
+	if (!token)
+		die("Next(): ArenaAlloc() == NULL");
+
+	return (lexer->flags & LEXER_DFA) ? LexDFA(lexer, token) : Lex(lexer, token);
 }
 
 Token* Peek(Lexer* lexer) {
+	if (lexer->flags & LEXER_BATCH)
+		return &lexer->tokens[lexer->cursor];
+
 	if (lexer->peek)
 		return lexer->peek;
 
@@ -316,10 +646,150 @@ Token* Peek(Lexer* lexer) {
 	return lexer->peek;
 }
 
+void ReleaseTokens(Lexer* lexer) {
+	if (lexer->flags & LEXER_BATCH)
+		return;
+
+	Token peek;
+	if (lexer->peek)
+		peek = *lexer->peek;
+
+	ArenaReset(&lexer->token_arena);
+	if (!lexer->peek)
+		return;
+
+	lexer->peek = ArenaAlloc(&lexer->token_arena, sizeof(Token));
+	if (!lexer->peek)
+		die("ReleaseTokens(): ArenaAlloc() == NULL");
+
+	*lexer->peek = peek;
+}
+
+/* Line numbers are only ever needed to report errors, so rather than 
+ * counting lines while lexing, we find all the newlines in one pass over 
+ * the source the first time someone asks, and binary search them after */
+static void BuildLineIndex(Lexer* lexer) {
+	uint32_t capacity = 64;
+	uint32_t* lines = malloc(sizeof(uint32_t) * capacity);
+	if (!lines)
+		die("BuildLineIndex(): malloc() == NULL");
+
+	uint32_t nlines = 0;
+	uint32_t offset = 0;
+	while (1) {
+		if (nlines >= capacity) {
+			capacity *= 2;
+			lines = realloc(lines, sizeof(uint32_t) * capacity);
+			if (!lines)
+				die("BuildLineIndex(): realloc() == NULL");
+		}
+
+		lines[nlines++] = offset;
+		offset = ScanLine(lexer->source, offset, lexer->size);
+		if (offset >= lexer->size)
+			break;
+
+		offset++; // the next line begins after the '\n'
+	}
+
+	lexer->lines = lines;
+	lexer->nlines = nlines;
+}
+
+// The 1-based column of source[to] in the line that begins at from
+static uint32_t Column(const char* source, uint32_t from, uint32_t to) {
+	uint32_t pos = 1;
+	for (uint32_t i = from; i < to; i++) {
+		if (source[i] == '\t') {
+			// Assume that tab stop is 8 spaces
+			pos -= pos % 8;
+			pos += 8;
+		} else if (((uint8_t) source[i] & 0xc0) != 0x80)
+			pos++; // a column for every code point
+	}
+
+	return pos;
+}
+
+/* A line that has left the window is found in Lexer.past, and read back
+ * from the file into Lexer.past_text, which fails on a pipe. The line and
+ * its start are known either way, so without the text the column is the
+ * number of bytes into the line */
+static LineInfo LocatePast(Lexer* lexer, uint32_t offset) {
+	LineInfo li = { 0 };
+
+	// Find the last line that begins at or before offset
+	uint32_t lo = 0, hi = lexer->npast;
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (lexer->past[mid] <= offset)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	uint32_t start = lexer->past[lo];
+	uint32_t end = (lo + 1 < lexer->npast) ? lexer->past[lo + 1] : 
+		lexer->base;
+	li.line = lo + 1;
+	li.pos = offset - start + 1;
+
+	free(lexer->past_text);
+	lexer->past_text = malloc(end - start + 1);
+	if (!lexer->past_text)
+		return li;
+
+	uint32_t got = 0;
+	while (got < end - start) {
+		ssize_t n = pread(lexer->fd, lexer->past_text + got, 
+				end - start - got, start + got);
+		if (n <= 0)
+			return li;
+
+		got += n;
+	}
+
+	li.text = lexer->past_text;
+	li.length = ScanLine(li.text, 0, got);
+	li.pos = Column(li.text, 0, offset - start);
+	return li;
+}
+
+LineInfo LexerLocate(Lexer* lexer, uint32_t offset) {
+	LineInfo li = { 0 };
+
+	// A streaming lexer only keeps the lines in its window
+	if (offset < lexer->base)
+		return lexer->npast ? LocatePast(lexer, offset) : li;
+
+	offset -= lexer->base;
+	if (!lexer->nlines)
+		BuildLineIndex(lexer);
+
+	// Find the last line that begins at or before offset
+	uint32_t lo = 0, hi = lexer->nlines;
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (lexer->lines[mid] <= offset)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	li.line = lexer->base_line + lo + 1;
+	li.text = lexer->source + lexer->lines[lo];
+	li.length = ScanLine(lexer->source, lexer->lines[lo], lexer->size) 
+		- lexer->lines[lo];
+	li.pos = Column(lexer->source, lexer->lines[lo], 
+			offset < lexer->size ? offset : lexer->size);
+
+	return li;
+}
+
 static const char* T2S[] = {
-	"EOF", "Number", "+", "-", "*", "/", ";", 
-	"let", "Identifier", "=", ":", "%", "(", ")", ",",
-	"function", "->", "{", "}", "token_max_invalid"
+#define TOKEN(type, desc) desc,
+#include "tokens.def"
+	"token_max_invalid"
 };
 
 void DumpToken(Lexer* lexer, Token* token) {
@@ -329,7 +799,7 @@ void DumpToken(Lexer* lexer, Token* token) {
 	if (token->type != TT_NUMBER && token->type != TT_IDENT)
 		printf("(%s)", desc);
 	else {
-		char* n = lexer->source + token->offset;
+		const char* n = TokenText(lexer, token);
 		char* text = malloc((token->length + 1) * sizeof(char));
 		memcpy(text, n, token->length);
 		text[token->length] = '\0';
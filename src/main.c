@@ -1,4 +1,7 @@
 #include "irgen.h"
+#include "bench.h"
+#include "incremental.h"
+#include "expr-pool.h"
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -8,28 +11,99 @@ int main(int argc, const char** argv) {
 	if (argc < 2) 
 		return 1;
 
+	const char* bench = getenv("LANG_BENCH");
+	if (bench)
+		return RunBenchmark(bench, argv[1]);
+
+	// Checks that both lexers produce the same tokens for the file
+	if (getenv("LANG_LEX_CHECK"))
+		return !CompareLexers(argv[1]);
+
+	// Checks that editing a document gives the same result as parsing it
+	if (getenv("LANG_INC_CHECK"))
+		return !CheckIncremental(argv[1]);
+
 	Lexer lexer; 
-	if (NewLexer(argv[1], &lexer))
+	LexerError err = getenv("LANG_STREAM") ? NewStreamLexer(argv[1], &lexer)
+		: NewLexer(argv[1], &lexer);
+	if (err)
+		return 1;
+
+	if (getenv("LANG_LEXER_DFA"))
+		lexer.flags |= LEXER_DFA;
+
+	// Function bodies are parsed when they are first needed, and not at all
+	// when only parsing
+	if (getenv("LANG_LAZY_BODIES") || getenv("LANG_PARSE_ONLY"))
+		lexer.flags |= LEXER_LAZY;
+
+	// Each phase allocates from an arena, freed once nothing needs it
+	uint32_t arena_flags = getenv("LANG_HUGE_PAGES") ? ARENA_HUGE : 0;
+	Arena ast, sema, ir_arena;
+	InitArena(&ast, arena_flags);
+	InitArena(&sema, arena_flags);
+	InitArena(&ir_arena, arena_flags);
+	lexer.arena = &ast;
+
+	// Identical subexpressions are parsed into one shared node
+	ExprPool pool;
+	InitExprPool(&pool);
+	if (getenv("LANG_HASH_CONS"))
+		lexer.pool = &pool;
+
+	const char* threads = getenv("LANG_LEX_THREADS");
+	if (threads)
+		lexer.threads = atoi(threads);
+
+	// A streaming lexer hands out tokens as it reads the input
+	if (!(lexer.flags & LEXER_STREAM) && LexAll(&lexer))
 		return 1;
 
 	Token* token = NULL;
 	Vector* stats = NewVector();
 
+	// Parses as much as it can on several threads, and leaves the rest,
+	// which starts with the first error, for the loop below
+	const char* parse_threads = getenv("LANG_PARSE_THREADS");
+	ParseParallel(&lexer, stats, parse_threads ? atoi(parse_threads) : 0);
+	for (uint32_t i = 0; i < VectorLength(stats); i++) {
+		DumpStatement(Get(stats, i));
+		printf("\n");
+	}
+
+	// When streaming, the tokens of a statement are freed once it has been
+	// parsed, and when only parsing, so is the statement, so that memory 
+	// does not grow with the input. Sema needs every statement, and the 
+	// pool every node
+	int drop = (lexer.flags & LEXER_STREAM) && getenv("LANG_PARSE_ONLY") &&
+		!lexer.pool;
 	while (1) {
+		ReleaseTokens(&lexer);
 		token = Peek(&lexer);
 		if (token->type == TT_EOF) {
 			Next(&lexer);
 			break;
 		}
 
+		// The parser copies what it needs out of the source, so only the
+		// current statement has to stay around when streaming
+		lexer.keep = token->offset;
+
 		Statement* stat = ParseStatement(&lexer);
 		if (!stat)
 			break;
 
-		Append(stats, stat);
-
 		DumpStatement(stat);
 		printf("\n");
+		if (drop) {
+			ArenaReset(&ast);
+			continue;
+		}
+
+		if (!Append(stats, stat)) {
+			printf("Internal Error: out of memory\n");
+			return 1;
+		}
 	}
 
 	if (!VectorLength(stats))
@@ -38,22 +112,35 @@ int main(int argc, const char** argv) {
 	if (getenv("LANG_PARSE_ONLY"))
 		return 0;
 
-	Vector* symtab = SemanticAnalyse(&lexer, stats);
+	// Function bodies are checked on several threads
+	const char* sema_threads = getenv("LANG_SEMA_THREADS");
+	SymbolTable* symtab = SemanticAnalyse(&lexer, stats, &sema, 
+			sema_threads ? atoi(sema_threads) : 0);
 	if (!symtab)
 		return 2;
 
 	if (getenv("LANG_SEMA_ONLY"))
 		return 0;
 
-	Vector* ir = GenIR(stats, symtab);
-	if (!ir) {
+	IR ir;
+	InitIR(&ir);
+	if (!GenIR(&ir, stats, &ir_arena)) {
 		printf("Internal Error: IR Generation failed\n");
 		return 3;
 	}
 
-	printf("IR Instructions = %u\n", VectorLength(ir));
-	PrintIR(ir);
-
+	// Only the IR is left to print
+	DeleteExprPool(&pool);
+	DeleteArena(&ast);
+	DeleteArena(&sema);
+	DeleteVector(stats);
+	DeleteSymbolTable(symtab);
 	DeleteLexer(&lexer);
+
+	printf("IR Instructions = %u\n", ir.ninsts);
+	PrintIR(&ir);
+
+	DeleteIR(&ir);
+	DeleteArena(&ir_arena);
 	return 0;
 }
@@ -1,36 +1,233 @@
 #include <stdlib.h>
-#include <stdint.h>
+#include <string.h>
 
-#include "vector.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-typedef uint32_t (*HashContents) (void* data);
-typedef int (*Compare) (void* e1, void* e2);
+#include "map.h"
 
-typedef struct Map {
-	Vector* map;
-	HashContents* hasher;
-	Compare* compare; 
-	uint32_t size;
-} Map;
+Map* NewMap(HashContents hasher, Compare compare) {
+	Map* map = calloc(1, sizeof(Map));
+	if (!map)
+		return NULL;
 
-typedef struct Entity {
-	void* key;
-	void* value;
-} Entity;
+	map->hasher = hasher;
+	map->compare = compare;
+	return map;
+}
+
+void DeleteMap(Map* map) {
+	if (!map)
+		return;
+
+	free(map->ctrl);
+	free(map->hashes);
+	free(map->entries);
+	free(map);
+}
+
+uint32_t MapLength(Map* map) {
+	return map->size;
+}
+
+/* A bit for every control byte of the group at ctrl that is equal to c. The
+ * control bytes are read past the end of the table into the copy of the
+ * first group there */
+static inline uint32_t MatchGroup(const uint8_t* ctrl, uint8_t c) {
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i*) ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+	uint32_t bits = 0;
+	for (int i = 0; i < MAP_GROUP; i++)
+		bits |= (uint32_t) (ctrl[i] == c) << i;
+
+	return bits;
+#endif
+}
+
+// The hash functions of the callers may be weak, like pointers that are all
+// aligned, so every bit is mixed into the top 7 and the slot
+static inline uint32_t Mix(uint32_t hash) {
+	hash ^= hash >> 16;
+	hash *= 0x7feb352d;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68b;
+	return hash ^ (hash >> 16);
+}
+
+static inline uint8_t Top7(uint32_t hash) {
+	return hash >> 25;
+}
+
+static inline void SetCtrl(Map* map, uint32_t slot, uint8_t c) {
+	map->ctrl[slot] = c;
+	if (slot < MAP_GROUP)
+		map->ctrl[map->capacity + slot] = c;
+}
+
+// The slot for hash in a map without it, which has an empty slot
+static uint32_t FreeSlot(Map* map, uint32_t hash) {
+	uint32_t mask = map->capacity - 1;
+	for (uint32_t pos = hash & mask;; pos = (pos + MAP_GROUP) & mask) {
+		uint32_t empty = MatchGroup(map->ctrl + pos, MAP_EMPTY);
+		if (empty)
+			return (pos + __builtin_ctz(empty)) & mask;
+	}
+}
+
+static int Resize(Map* map, uint32_t capacity) {
+	uint8_t* ctrl = malloc(capacity + MAP_GROUP);
+	uint32_t* hashes = malloc(capacity * sizeof(uint32_t));
+	MapEntry* entries = malloc(capacity * sizeof(MapEntry));
+	if (!ctrl || !hashes || !entries) {
+		free(ctrl);
+		free(hashes);
+		free(entries);
+		return 0;
+	}
+
+	memset(ctrl, MAP_EMPTY, capacity + MAP_GROUP);
+	Map old = *map;
+	map->ctrl = ctrl;
+	map->hashes = hashes;
+	map->entries = entries;
+	map->capacity = capacity;
+
+	for (uint32_t i = 0; i < old.capacity; i++) {
+		if (old.ctrl[i] == MAP_EMPTY)
+			continue;
+
+		uint32_t slot = FreeSlot(map, old.hashes[i]);
+		SetCtrl(map, slot, old.ctrl[i]);
+		hashes[slot] = old.hashes[i];
+		entries[slot] = old.entries[i];
+	}
+
+	free(old.ctrl);
+	free(old.hashes);
+	free(old.entries);
+	return 1;
+}
+
+// At most 7/8 of the slots are used
+int MapReserve(Map* map, uint32_t count) {
+	uint64_t capacity = (map->capacity) ? map->capacity : MAP_GROUP;
+	while ((uint64_t) count * 8 > capacity * 7)
+		capacity *= 2;
+
+	if (capacity > UINT32_MAX / 2 + 1)
+		return 0;
+
+	return capacity == map->capacity || Resize(map, capacity);
+}
+
+MapEntry* MapFindHashed(Map* map, void* key, uint32_t hash) {
+	if (!map->size)
+		return NULL;
+
+	hash = Mix(hash);
+	uint32_t mask = map->capacity - 1;
+	uint8_t top = Top7(hash);
+
+	for (uint32_t pos = hash & mask;; pos = (pos + MAP_GROUP) & mask) {
+		const uint8_t* group = map->ctrl + pos;
+		for (uint32_t match = MatchGroup(group, top); match;
+				match &= match - 1) {
+			uint32_t slot = (pos + __builtin_ctz(match)) & mask;
+			if (map->hashes[slot] == hash &&
+					!map->compare(map->entries[slot].key, key))
+				return &map->entries[slot];
+		}
+
+		// A key is never past an empty slot after the slot it hashes to
+		if (MatchGroup(group, MAP_EMPTY))
+			return NULL;
+	}
+}
+
+MapEntry* MapFind(Map* map, void* key) {
+	return (map->size) ? MapFindHashed(map, key, map->hasher(key)) : NULL;
+}
+
+void* MapGet(Map* map, void* key) {
+	MapEntry* entry = MapFind(map, key);
+	return (entry) ? entry->value : NULL;
+}
+
+MapEntry* MapInsertHashed(Map* map, void* key, uint32_t hash, void* value) {
+	MapEntry* entry = MapFindHashed(map, key, hash);
+	if (entry)
+		return entry;
+
+	if (!MapReserve(map, map->size + 1))
+		return NULL;
+
+	hash = Mix(hash);
+	uint32_t slot = FreeSlot(map, hash);
+	SetCtrl(map, slot, Top7(hash));
+	map->hashes[slot] = hash;
+	map->entries[slot].key = key;
+	map->entries[slot].value = value;
+	map->size++;
+	return &map->entries[slot];
+}
+
+int MapInsert(Map* map, void* key, void* value) {
+	MapEntry* entry = MapInsertHashed(map, key, map->hasher(key), value);
+	if (!entry)
+		return 0;
+
+	entry->value = value;
+	return 1;
+}
 
-enum EntryType {
-	ETYPE_DATA,
-	ETYPE_COLLISION
-} EntryType;
+/* Every key after the hole, up to the next empty slot, is moved back into
+ * the hole if the hole is not before the slot it hashes to, which leaves a
+ * new hole where it was */
+int MapRemove(Map* map, void* key) {
+	MapEntry* entry = MapFind(map, key);
+	if (!entry)
+		return 0;
 
-typedef struct Entry {
-	union {
-		Vector* colliders;
-		Entity* data;
-	};
-	int type;
-} Entry;
+	uint32_t mask = map->capacity - 1;
+	uint32_t hole = entry - map->entries;
+	for (uint32_t slot = (hole + 1) & mask; map->ctrl[slot] != MAP_EMPTY;
+			slot = (slot + 1) & mask) {
+		uint32_t home = map->hashes[slot] & mask;
+		if (((slot - home) & mask) < ((slot - hole) & mask))
+			continue;
+
+		SetCtrl(map, hole, map->ctrl[slot]);
+		map->hashes[hole] = map->hashes[slot];
+		map->entries[hole] = map->entries[slot];
+		hole = slot;
+	}
+
+	SetCtrl(map, hole, MAP_EMPTY);
+	map->size--;
+	return 1;
+}
 
-Map* NewMap(HashContents* hasher, Compare* compare) {
+// FNV-1a
+uint32_t HashString(void* data) {
+	uint32_t hash = 2166136261u;
+	for (const char* c = data; *c; c++)
+		hash = (hash ^ (uint8_t) *c) * 16777619u;
+
+	return hash;
+}
+
+int CompareStrings(void* e1, void* e2) {
+	return strcmp(e1, e2);
+}
+
+uint32_t HashPointer(void* data) {
+	uintptr_t p = (uintptr_t) data;
+	return (uint32_t) (p ^ (p >> 32));
+}
 
+int ComparePointers(void* e1, void* e2) {
+	return e1 != e2;
 }
@@ -0,0 +1,122 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "map.h"
+#include "names.h"
+
+// The texts are found through blocks of NAME_BLOCK pointers that never move
+// once allocated, so that NameText() can read them while a name is added
+#define NAME_BLOCK_BITS 12
+#define NAME_BLOCK      (1u << NAME_BLOCK_BITS)
+#define NAME_BLOCKS     (1u << (32 - NAME_BLOCK_BITS))
+
+// What the map is keyed with, the text of the key a lookup makes is not
+// NUL terminated, it points into the source
+typedef struct NameKey {
+	const char* text;
+	uint32_t length;
+} NameKey;
+
+static struct {
+	pthread_mutex_t lock;
+	Map*   map;     // NameKey -> Name
+	Arena  arena;   // the keys and their texts
+	uint32_t count; // names handed out, Name 0 aside
+	const char** blocks[NAME_BLOCKS];
+} names = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Each thread remembers the names it interned last in a slot picked by
+// their hash, so that the lock is only taken for a name it has not seen
+// lately. The text is checked through NameText(), which takes no lock
+#define NAME_CACHE 1024
+
+typedef struct CachedName {
+	uint32_t hash;
+	Name name;
+} CachedName;
+
+static __thread CachedName cache[NAME_CACHE];
+
+static uint32_t HashKey(void* data) {
+	NameKey* key = data;
+	return HashName(key->text, key->length);
+}
+
+static int CompareKeys(void* e1, void* e2) {
+	NameKey* a = e1;
+	NameKey* b = e2;
+	return a->length != b->length || memcmp(a->text, b->text, a->length);
+}
+
+// Stores the text of key for good, called with the lock held
+static Name AddName(NameKey* key, uint32_t hash) {
+	Name name = names.count + 1;
+	if (!name)
+		return 0;
+
+	const char*** block = &names.blocks[name >> NAME_BLOCK_BITS];
+	if (!*block && !(*block = calloc(NAME_BLOCK, sizeof(char*))))
+		return 0;
+
+	NameKey* stored = ArenaAlloc(&names.arena, sizeof(NameKey));
+	char* text = ArenaAlloc(&names.arena, key->length + 1);
+	if (!stored || !text)
+		return 0;
+
+	memcpy(text, key->text, key->length);
+	text[key->length] = '\0';
+	stored->text = text;
+	stored->length = key->length;
+
+	MapEntry* entry = MapInsertHashed(names.map, stored, hash,
+			(void*) (uintptr_t) name);
+	if (!entry)
+		return 0;
+
+	(*block)[name & (NAME_BLOCK - 1)] = text;
+	names.count++;
+	return name;
+}
+
+Name InternName(const char* text, uint32_t length, uint32_t hash) {
+	CachedName* cached = &cache[hash & (NAME_CACHE - 1)];
+	if (cached->name && cached->hash == hash) {
+		const char* known = NameText(cached->name);
+		if (!strncmp(known, text, length) && known[length] == '\0')
+			return cached->name;
+	}
+
+	NameKey key = { text, length };
+	Name name = 0;
+
+	pthread_mutex_lock(&names.lock);
+	if (!names.map)
+		names.map = NewMap(HashKey, CompareKeys);
+
+	if (names.map) {
+		MapEntry* entry = MapFindHashed(names.map, &key, hash);
+		name = (entry) ? (Name) (uintptr_t) entry->value :
+			AddName(&key, hash);
+	}
+
+	pthread_mutex_unlock(&names.lock);
+	if (name)
+		*cached = (CachedName) { hash, name };
+
+	return name;
+}
+
+Name InternString(const char* text) {
+	uint32_t length = strlen(text);
+	return InternName(text, length, HashName(text, length));
+}
+
+const char* NameText(Name name) {
+	return names.blocks[name >> NAME_BLOCK_BITS][name & (NAME_BLOCK - 1)];
+}
+
+uint32_t NameCount() {
+	return names.count;
+}
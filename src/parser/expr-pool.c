@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "expr-pool.h"
+#include "parser-utils.h"
+
+void InitExprPool(ExprPool* pool) {
+	memset(pool, 0, sizeof(ExprPool));
+}
+
+// Sema puts casts between a shared node and its operands, those are the only
+// operands that are not shared themselves
+static void DeleteOwnedOperand(Expr* operand) {
+	if (!(operand->flags & EXPR_SHARED))
+		DeleteExpr(operand);
+}
+
+void DeleteExprPool(ExprPool* pool) {
+	// The casts are freed first, as freeing them looks at their operands
+	for (uint32_t i = 0; i < pool->capacity; i++) {
+		Expr* expr = pool->slots[i];
+		if (!expr)
+			continue;
+
+		switch (expr->type) {
+			case ET_UNARY_OP: DeleteOwnedOperand(expr->unop->operand); break;
+			case ET_CAST: DeleteOwnedOperand(expr->cast->expr); break;
+			case ET_BINARY_OP: {
+				DeleteOwnedOperand(expr->binop->left);
+				DeleteOwnedOperand(expr->binop->right);
+				break;
+			}
+			default: break;
+		}
+	}
+
+	for (uint32_t i = 0; i < pool->capacity; i++)
+		if (pool->slots[i])
+			DeleteExprNode(pool->slots[i]);
+
+	free(pool->slots);
+	free(pool->hashes);
+	InitExprPool(pool);
+}
+
+static uint64_t Mix(uint64_t hash, uint64_t value) {
+	hash = (hash ^ value) * 0x9e3779b97f4a7c15;
+	return hash ^ (hash >> 29);
+}
+
+// The operands are already interned, so their pointers stand for them
+static uint32_t HashExpr(Expr* expr) {
+	uint64_t hash = Mix(0, expr->type);
+	switch (expr->type) {
+		case ET_INT_LITERAL: {
+			hash = Mix(hash, (uintptr_t) expr->literal->type);
+			hash = Mix(hash, expr->literal->number);
+			break;
+		}
+
+		case ET_IDENT: {
+			hash = Mix(hash, (uintptr_t) expr->sym);
+			break;
+		}
+
+		case ET_UNARY_OP: {
+			hash = Mix(hash, expr->unop->type);
+			hash = Mix(hash, (uintptr_t) expr->unop->operand);
+			break;
+		}
+
+		case ET_BINARY_OP: {
+			hash = Mix(hash, expr->binop->type);
+			hash = Mix(hash, (uintptr_t) expr->binop->left);
+			hash = Mix(hash, (uintptr_t) expr->binop->right);
+			break;
+		}
+
+		case ET_CAST: {
+			hash = Mix(hash, (uintptr_t) expr->cast->target);
+			hash = Mix(hash, (uintptr_t) expr->cast->expr);
+			break;
+		}
+
+		default: break;
+	}
+
+	return (uint32_t) hash;
+}
+
+static int Identical(Expr* a, Expr* b) {
+	if (a->type != b->type)
+		return 0;
+
+	switch (a->type) {
+		case ET_INT_LITERAL:
+			return a->literal->type == b->literal->type &&
+				a->literal->number == b->literal->number;
+		case ET_IDENT: return a->sym == b->sym;
+		case ET_UNARY_OP:
+			return a->unop->type == b->unop->type &&
+				a->unop->operand == b->unop->operand;
+		case ET_BINARY_OP:
+			return a->binop->type == b->binop->type &&
+				a->binop->left == b->binop->left &&
+				a->binop->right == b->binop->right;
+		case ET_CAST:
+			return a->cast->target == b->cast->target &&
+				a->cast->expr == b->cast->expr;
+		default: return 0;
+	}
+}
+
+// A name stands for whichever variable is in scope where it appears, so it
+// is only shared once sema has resolved it, as that variable
+static int Internable(Expr* expr) {
+	switch (expr->type) {
+		case ET_INT_LITERAL: return 1;
+		case ET_IDENT: return expr->sym != NULL;
+		case ET_UNARY_OP: return expr->unop->operand->flags & EXPR_SHARED;
+		case ET_BINARY_OP:
+			return expr->binop->left->flags & expr->binop->right->flags &
+				EXPR_SHARED;
+		case ET_CAST: return expr->cast->expr->flags & EXPR_SHARED;
+		default: return 0;
+	}
+}
+
+// Doubles the table, which starts out with room for 64 nodes
+static int GrowPool(ExprPool* pool) {
+	uint32_t capacity = (pool->capacity) ? pool->capacity * 2 : 64;
+	Expr** slots = calloc(capacity, sizeof(Expr*));
+	uint32_t* hashes = malloc(capacity * sizeof(uint32_t));
+	if (!slots || !hashes) {
+		free(slots);
+		free(hashes);
+		return 0;
+	}
+
+	uint32_t mask = capacity - 1;
+	for (uint32_t i = 0; i < pool->capacity; i++) {
+		if (!pool->slots[i])
+			continue;
+
+		uint32_t slot = pool->hashes[i] & mask;
+		while (slots[slot])
+			slot = (slot + 1) & mask;
+
+		slots[slot] = pool->slots[i];
+		hashes[slot] = pool->hashes[i];
+	}
+
+	free(pool->slots);
+	free(pool->hashes);
+	pool->slots = slots;
+	pool->hashes = hashes;
+	pool->capacity = capacity;
+	return 1;
+}
+
+Expr* InternExpr(ExprPool* pool, Expr* expr) {
+	if (!Internable(expr))
+		return expr;
+
+	// At most 3/4 full
+	if ((pool->count + 1) * 4 > pool->capacity * 3 && !GrowPool(pool))
+		return expr;
+
+	uint32_t hash = HashExpr(expr);
+	uint32_t mask = pool->capacity - 1;
+	for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask) {
+		Expr* found = pool->slots[slot];
+		if (!found) {
+			pool->slots[slot] = expr;
+			pool->hashes[slot] = hash;
+			pool->count++;
+			expr->flags |= EXPR_SHARED;
+			return expr;
+		}
+
+		if (pool->hashes[slot] == hash && Identical(found, expr)) {
+			DeleteExprNode(expr);
+			pool->hits++;
+			return found;
+		}
+	}
+}
+
+size_t ExprPoolBytes(ExprPool* pool) {
+	size_t bytes = pool->capacity * (sizeof(Expr*) + sizeof(uint32_t));
+	for (uint32_t i = 0; i < pool->capacity; i++) {
+		Expr* expr = pool->slots[i];
+		if (!expr)
+			continue;
+
+		bytes += sizeof(Expr);
+		switch (expr->type) {
+			case ET_INT_LITERAL: bytes += sizeof(IntLiteral); break;
+			case ET_UNARY_OP: bytes += sizeof(UnaryOp); break;
+			case ET_BINARY_OP: bytes += sizeof(BinaryOp); break;
+			case ET_CAST: bytes += sizeof(Cast); break;
+			default: break;
+		}
+	}
+
+	return bytes;
+}
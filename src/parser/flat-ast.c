@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flat-ast.h"
+
+void InitFlatAst(FlatAst* ast) {
+	memset(ast, 0, sizeof(FlatAst));
+}
+
+void DeleteFlatAst(FlatAst* ast) {
+	free(ast->kinds);
+	free(ast->ops);
+	free(ast->offsets);
+	free(ast->args);
+	free(ast->types);
+	free(ast->literals);
+	free(ast->idents);
+	free(ast->symbols);
+	free(ast->targets);
+	InitFlatAst(ast);
+}
+
+// Doubles the capacity of an array, which starts out with room for 16
+static int Grow(void** array, size_t size, uint32_t* capacity) {
+	uint32_t count = (*capacity) ? *capacity * 2 : 16;
+	void* grown = realloc(*array, count * size);
+	if (!grown)
+		return 0;
+
+	*array = grown;
+	*capacity = count;
+	return 1;
+}
+
+#define RESERVE(array, count, capacity) \
+	((count) < (capacity) || Grow((void**) &(array), sizeof(*(array)), \
+		&(capacity)))
+
+static int GrowNodes(FlatAst* ast) {
+	// The capacity is only updated once all of the arrays have grown
+	uint32_t capacity = ast->max_nodes;
+	if (!Grow((void**) &ast->kinds, sizeof(uint8_t), &capacity))
+		return 0;
+
+	capacity = ast->max_nodes;
+	if (!Grow((void**) &ast->ops, sizeof(uint8_t), &capacity))
+		return 0;
+
+	capacity = ast->max_nodes;
+	if (!Grow((void**) &ast->offsets, sizeof(uint32_t), &capacity))
+		return 0;
+
+	capacity = ast->max_nodes;
+	if (!Grow((void**) &ast->args, sizeof(uint32_t), &capacity))
+		return 0;
+
+	capacity = ast->max_nodes;
+	if (!Grow((void**) &ast->types, sizeof(Type*), &capacity))
+		return 0;
+
+	ast->max_nodes = capacity;
+	return 1;
+}
+
+static int GrowIdents(FlatAst* ast) {
+	uint32_t capacity = ast->max_idents;
+	if (!Grow((void**) &ast->idents, sizeof(Name), &capacity))
+		return 0;
+
+	capacity = ast->max_idents;
+	if (!Grow((void**) &ast->symbols, sizeof(struct Symbol*), &capacity))
+		return 0;
+
+	ast->max_idents = capacity;
+	return 1;
+}
+
+static uint32_t AddNode(FlatAst* ast, Expr* expr, OperatorCode op,
+		uint32_t arg) {
+	if (ast->nnodes == ast->max_nodes && !GrowNodes(ast))
+		return UINT32_MAX;
+
+	uint32_t node = ast->nnodes++;
+	ast->kinds[node] = expr->type;
+	ast->ops[node] = op;
+	ast->offsets[node] = expr->loc.offset;
+	ast->args[node] = arg;
+	ast->types[node] = TypeOfExpr(expr);
+	return node;
+}
+
+static uint32_t AddLeaf(FlatAst* ast, Expr* expr) {
+	switch (expr->type) {
+		case ET_INT_LITERAL: {
+			if (!RESERVE(ast->literals, ast->nliterals, ast->max_literals))
+				return UINT32_MAX;
+
+			ast->literals[ast->nliterals] = *expr->literal;
+			return AddNode(ast, expr, 0, ast->nliterals++);
+		}
+
+		case ET_IDENT: {
+			if (ast->nidents == ast->max_idents && !GrowIdents(ast))
+				return UINT32_MAX;
+
+			ast->idents[ast->nidents] = expr->ident;
+			ast->symbols[ast->nidents] = expr->sym;
+			return AddNode(ast, expr, 0, ast->nidents++);
+		}
+
+		case ET_CAST: {
+			if (!RESERVE(ast->targets, ast->ntargets, ast->max_targets))
+				return UINT32_MAX;
+
+			ast->targets[ast->ntargets] = expr->cast->target;
+			return AddNode(ast, expr, 0, ast->ntargets++);
+		}
+
+		default: return UINT32_MAX;
+	}
+}
+
+/* The tree comes out of the walk in the order of the nodes. Only a binary op
+ * needs to know where its left operand is, which is the root of the last
+ * but one subtree that has not been used as an operand yet, so those are
+ * kept on a stack */
+uint32_t FlattenExpr(FlatAst* ast, Expr* expr) {
+	uint32_t* roots = NULL;
+	uint32_t nroots = 0, max_roots = 0;
+	uint32_t node = UINT32_MAX;
+	ExprWalk walk;
+
+	BeginExprWalk(&walk, expr);
+	while ((expr = NextExpr(&walk))) {
+		switch (expr->type) {
+			case ET_UNARY_OP: {
+				node = AddNode(ast, expr, expr->unop->type, 0);
+				nroots--;
+				break;
+			}
+
+			case ET_BINARY_OP: {
+				uint32_t left = roots[nroots - 2];
+				node = AddNode(ast, expr, expr->binop->type, left);
+				nroots -= 2;
+				break;
+			}
+
+			case ET_CAST: nroots--; // fallthrough
+			default: node = AddLeaf(ast, expr);
+		}
+
+		if (node == UINT32_MAX || 
+				!RESERVE(roots, nroots, max_roots)) {
+			node = UINT32_MAX;
+			break;
+		}
+
+		roots[nroots++] = node;
+	}
+
+	if (walk.failed)
+		node = UINT32_MAX;
+
+	EndExprWalk(&walk);
+	free(roots);
+	return node;
+}
+
+void DumpFlatExpr(FlatAst* ast, uint32_t first, uint32_t root) {
+	for (uint32_t node = first; node <= root; node++) {
+		uint32_t arg = ast->args[node];
+		switch (ast->kinds[node]) {
+			case ET_INT_LITERAL:
+				PrintLiteral(ast->literals[arg].type, ast->literals[arg].number);
+				printf(" ");
+				break;
+			case ET_IDENT: printf("%s ", NameText(ast->idents[arg])); break;
+			case ET_UNARY_OP:
+			case ET_BINARY_OP:
+				printf("%s ", Operator2String(ast->ops[node])); break;
+			case ET_CAST: printf("(%s)", ast->targets[arg]->name); break;
+		}
+	}
+}
+
+// The memory in use by the nodes
+size_t FlatAstBytes(FlatAst* ast) {
+	return ast->nnodes * (2 * sizeof(uint8_t) + 2 * sizeof(uint32_t) +
+			sizeof(Type*)) +
+		ast->nliterals * sizeof(IntLiteral) +
+		ast->nidents * (sizeof(Name) + sizeof(struct Symbol*)) + 
+		ast->ntargets * sizeof(Type*);
+}
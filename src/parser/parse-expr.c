@@ -2,9 +2,10 @@
 #include <string.h>
 #include "parser-utils.h"
 #include "parse-expr.h"
+#include "expr-pool.h"
 #include <stdio.h>
 
-int ParseIntLiteral(Lexer* lexer, Token* token, Expr* expr);
+int ParseIntLiteral(Lexer* lexer, Token* token, Expr* expr, int negated);
 int ParseIdent(Lexer* lexer, Token* token, Expr* expr);
 
 static uint16_t infix_binding_power[] = {
@@ -38,54 +39,6 @@ static int OpToInfixIndex(TokenType type) {
 	}
 }
 
-static Vector* ParseFunCall(Lexer* lexer, Token* callop) {
-	Vector* args = NewVector();
-
-	while (1) {
-		Token* token = Peek(lexer);
-		if (token->type == TT_RPAREN) {
-			Next(lexer);
-			break;
-		}
-
-		Expr* expr = PrattParseExpr(lexer, NULL, 0);
-		if (!expr) {
-			ParserError(lexer, token, "Expected valid expression here");
-			return NULL;
-		}
-
-		Append(args, expr);
-		token = Peek(lexer);
-		if (token->type == TT_RPAREN) {
-			Next(lexer);
-			break;
-		}
-
-		else if (token->type == TT_COMMA) {
-			Next(lexer);
-			token = Peek(lexer);
-			if (token->type == TT_RPAREN) {
-				ParserError(lexer, token, 
-					"Parameters expected after ','");
-				return NULL;
-			}
-		}
-		else {
-			ParserError(lexer, token, "Expected ','/'')' here");
-			return NULL;
-		}
-	}
-
-	// For the moment, function calls are only the built-in type casts, 
-	// so there should only be 1 argument
-	if (VectorLength(args) != 1) {
-		ParserError(lexer, callop, "Only 1 argument is needed");
-		return NULL;
-	}
-
-	return args;
-}
-
 Type* ValidateFunCall(Lexer* lexer, Expr* name, Token* tname) {
 	if (name->type != ET_IDENT) {
 		ParserError(lexer, tname, "Expected identifier before '('");
@@ -95,7 +48,7 @@ Type* ValidateFunCall(Lexer* lexer, Expr* name, Token* tname) {
 	Type* totype = NULL;
 
 	for (int i = 0; i < len_builtins; i++) {
-		if (strcmp(BUILTIN_TYPES[i]->name, name->ident) == 0) {
+		if (strcmp(BUILTIN_TYPES[i]->name, NameText(name->ident)) == 0) {
 			totype = BUILTIN_TYPES[i];
 			break;
 		}
@@ -109,83 +62,175 @@ Type* ValidateFunCall(Lexer* lexer, Expr* name, Token* tname) {
 	return totype;
 }
 
-static Expr* ParsePredicate(Lexer* lexer) { 
-	Token* tlhs = Next(lexer);
-	Expr* lhs = NULL;
+/* The parser is the usual Pratt loop, but instead of recursing for the
+ * operand of a prefix operator, the right operand of a binary operator, a
+ * parenthesized expression or the argument of a call, the operator is pushed
+ * on a stack of frames, and popped off again once its operand has been
+ * parsed. So the depth of nesting is only bounded by memory */
+
+enum FrameKind {
+	FRAME_PREFIX,
+	FRAME_BINARY,
+	FRAME_PAREN,
+	FRAME_CALL
+};
+
+typedef struct Frame {
+	enum FrameKind kind;
+	int minbp;          // of the loop that the operator was found in
+	Token* token;       // the operator, '(' or the '(' of a call
+	union {
+		Expr* lhs;      // FRAME_BINARY
+		struct {        // FRAME_CALL
+			Type* target;
+			Expr* arg;  // the first argument, which is all that a cast takes
+			uint32_t nargs;
+			Token* start; // where the argument being parsed starts
+		};
+	};
+} Frame;
+
+// Frames that fit on the C stack before the heap is used
+#define FRAMES_INLINE 32
+DEFINE_VECTOR(FrameStack, Frame, FRAMES_INLINE)
+
+static Frame* PushFrame(FrameStack* stack, enum FrameKind kind, int minbp,
+		Token* token) {
+	Frame* frame = PushFrameStack(stack);
+	if (!frame)
+		return NULL;
+
+	frame->kind = kind;
+	frame->minbp = minbp;
+	frame->token = token;
+	frame->lhs = NULL;
+	frame->arg = NULL;
+	frame->nargs = 0;
+	return frame;
+}
+
+static void DeleteFrame(Lexer* lexer, Frame* frame, int failed) {
+	if (frame->kind == FRAME_BINARY)
+		DeleteExpr(frame->lhs);
+	else if (frame->kind == FRAME_CALL) {
+		DeleteExpr(frame->arg);
+
+		// Unless the call itself is what failed, its argument did
+		if (!failed)
+			ParserError(lexer, frame->start, "Expected valid expression here");
+	}
+}
+
+/* Hash-conses a finished node if the lexer has an ExprPool. The bodies 
+ * LEXER_LAZY skipped are parsed after what follows them, so a shared node 
+ * is given the location it appears at first in the file, which sema uses 
+ * to tell the first of them from the others, see UseSite() */
+static Expr* Share(Lexer* lexer, Expr* expr) {
+	if (!lexer->pool)
+		return expr;
+
+	uint32_t offset = expr->loc.offset;
+	expr = InternExpr(lexer->pool, expr);
+	if (expr->loc.offset > offset)
+		expr->loc.offset = offset;
+
+	return expr;
+}
+
+/* A literal right after a '-' is passed the minus. A signed one takes the 
+ * '-' in, so that -128i8 is one constant, while negating an unsigned one is 
+ * left to the caller, for sema to report */
+static Expr* ParseLiteral(Lexer* lexer, Token* token, Token* minus) {
+	Expr* expr = makeExpr(lexer->arena, ET_INT_LITERAL);
+	if (!ParseIntLiteral(lexer, token, expr, minus != NULL)) {
+		DeleteExpr(expr);
+		return NULL;
+	}
+
+	expr->loc.offset = token->offset;
+	if (minus && !TypeIsUnsigned(expr->literal->type)) {
+		expr->literal->number = -expr->literal->number;
+		expr->loc.offset = minus->offset;
+	}
+
+	return Share(lexer, expr);
+}
+
+Expr* PrattParseExpr(Lexer* lexer, Expr* expr, int minbp) {
+	FrameStack stack;
+	InitFrameStack(&stack);
+
+	Expr* lhs = expr;
+	Frame* frame = NULL;
+	Token* token = NULL;
+
+	if (lhs) {
+		lhs = Share(lexer, lhs);
+		goto parse_infix;
+	}
 
-	switch (tlhs->type) {
-		case TT_NUMBER: { 
-			lhs = makeExpr(ET_INT_LITERAL);
-			if (!ParseIntLiteral(lexer, tlhs, lhs))
-				return NULL;
+parse_predicate:
+	token = Next(lexer);
+	switch (token->type) {
+		case TT_NUMBER: {
+			lhs = ParseLiteral(lexer, token, NULL);
+			if (!lhs)
+				goto fail;
 
-				break;
+			goto parse_infix;
 		}
 
 		case TT_IDENT: {
-			lhs = makeExpr(ET_IDENT);
-			if (!ParseIdent(lexer, tlhs, lhs))
-				return NULL;
+			lhs = makeExpr(lexer->arena, ET_IDENT);
+			if (!ParseIdent(lexer, token, lhs))
+				goto fail;
 
-			break;
+			lhs->loc.offset = token->offset;
+			lhs = Share(lexer, lhs);
+			goto parse_infix;
 		}
 
 		case TT_LPAREN: {
-			Expr* paren_expr = PrattParseExpr(lexer, NULL, 0);
-			if (!paren_expr) 
-				return NULL;
-
-			if (!Expect(lexer, TT_RPAREN, "Expected ')' to end "
-							"parenthesized expression"))
-					return NULL;
+			if (!PushFrame(&stack, FRAME_PAREN, minbp, token))
+				goto fail;
 
-			lhs = paren_expr;
-			break;
+			minbp = 0;
+			goto parse_predicate;
 		}
 
-			
 		default: {
-			if (IsPrefixOperator(tlhs->type)) {
-					
-				int r_bp = prefix_binding_power[OpToPrefixIndex(tlhs->type)];
-				Expr* operand = PrattParseExpr(lexer, NULL, r_bp);
-				if (!operand)
-						return NULL;
-
-				lhs = makeExpr(ET_UNARY_OP);
-				lhs->unop = malloc(sizeof(UnaryOp));
-				lhs->unop->type = OpToUnop(tlhs->type);
-				lhs->unop->operand = operand;
-				lhs->unop->loc.line = tlhs->line;
-				lhs->unop->loc.pos = tlhs->pos;
-				break;
+			if (IsPrefixOperator(token->type)) {
+				// -128i8 is in range even though 128i8 is not
+				Expr* literal = NULL;
+				Token* tnum = Peek(lexer);
+				if (token->type == TT_MINUS && tnum->type == TT_NUMBER) {
+					Next(lexer);
+					literal = ParseLiteral(lexer, tnum, token);
+					if (!literal)
+						goto fail;
+
+					lhs = literal;
+					if (!TypeIsUnsigned(literal->literal->type))
+						goto parse_infix; // the '-' is part of the literal
+				}
+
+				if (!PushFrame(&stack, FRAME_PREFIX, minbp, token))
+					goto fail;
+
+				minbp = prefix_binding_power[OpToPrefixIndex(token->type)];
+				if (literal)
+					goto parse_infix;
+
+				goto parse_predicate;
 			}
 
-			ParserError(lexer, tlhs, "Expected literal/identifier/" 
+			ParserError(lexer, token, "Expected literal/identifier/" 
 						"'+'/'-' or '(' here");
-			return NULL;
+			goto fail;
 		}
 	}
 
-	if (lhs) {
-		lhs->loc.line = tlhs->line;
-		lhs->loc.pos = tlhs->pos;
-	}
-
-	return lhs;
-}
-
-Expr* PrattParseExpr(Lexer* lexer, Expr* expr, int minbp) {
-	Expr* lhs = NULL;
-	if (!expr) {
-		lhs = ParsePredicate(lexer);
-		if (!lhs) 
-			return NULL;
-
-	}  else { 
-		lhs = expr;
-	}
-	
+parse_infix:
 	while (1) {
 		Token* op = Peek(lexer);
 		if (op->type == TT_SEMICOLON || op->type == TT_EOF)
@@ -201,46 +246,150 @@ Expr* PrattParseExpr(Lexer* lexer, Expr* expr, int minbp) {
 			break;
 
 		Next(lexer);
-		Expr* rhs = NULL;
 
 		if (op->type == TT_LPAREN) {
 			Type* type = ValidateFunCall(lexer, lhs, op);
 			if (!type)
-				return NULL;
-
-			Vector* args = ParseFunCall(lexer, op);
-			if (!args)
-				return NULL;
-
-			rhs = makeExpr(ET_CAST);
-			rhs->cast = malloc(sizeof(Cast));
-			rhs->cast->target = type;
-			rhs->cast->expr = Get(args, 0);
-			lhs = rhs;
-			lhs->loc.line = op->line;
-			lhs->loc.pos = op->pos;
-			continue;
+				goto fail;
+
+			// For the moment, function calls are only the built-in type 
+			// casts, so the name is no longer needed
+			frame = PushFrame(&stack, FRAME_CALL, minbp, op);
+			if (!frame)
+				goto fail;
+
+			DeleteExpr(lhs);
+			lhs = NULL;
+			frame->target = type;
+
+			if (Peek(lexer)->type == TT_RPAREN) {
+				Next(lexer);
+				goto parse_cast;
+			}
+
+			goto parse_argument;
 		}
-		else {
-			rhs = PrattParseExpr(lexer, NULL, r_bp);
-			if (!rhs)
-				return NULL;
+
+		frame = PushFrame(&stack, FRAME_BINARY, minbp, op);
+		if (!frame)
+			goto fail;
+
+		frame->lhs = lhs;
+		lhs = NULL;
+		minbp = r_bp;
+		goto parse_predicate;
+	}
+
+	// lhs is as long as it gets, so it is the operand of the top frame
+	if (!stack.size)
+		goto done;
+
+	frame = FrameStackAt(&stack, stack.size - 1);
+	switch (frame->kind) {
+		case FRAME_PREFIX: {
+			Expr* unop = makeExpr(lexer->arena, ET_UNARY_OP);
+			unop->unop = Allocate(lexer->arena, sizeof(UnaryOp));
+			unop->unop->type = OpToUnop(frame->token->type);
+			unop->unop->operand = lhs;
+			unop->unop->loc.offset = frame->token->offset;
+			unop->loc.offset = frame->token->offset;
+			lhs = Share(lexer, unop);
+			break;
 		}
 
-		Expr* tmp = makeExpr(ET_BINARY_OP);
-		tmp->loc.line = op->line;
-		tmp->loc.pos = op->pos;
+		case FRAME_BINARY: {
+			Expr* tmp = makeExpr(lexer->arena, ET_BINARY_OP);
+			tmp->loc.offset = frame->token->offset;
 
-		tmp->binop = malloc(sizeof(BinaryOp));
-		tmp->binop->loc.line = op->line;
-		tmp->binop->loc.pos = op->pos;
-		tmp->binop->type = OpToBinop(op->type);
-		tmp->binop->left = lhs;
-		tmp->binop->right = rhs;
+			tmp->binop = Allocate(lexer->arena, sizeof(BinaryOp));
+			tmp->binop->loc.offset = frame->token->offset;
+			tmp->binop->type = OpToBinop(frame->token->type);
+			tmp->binop->left = frame->lhs;
+			tmp->binop->right = lhs;
+			lhs = Share(lexer, tmp);
+			break;
+		}
 
-		lhs = tmp;
+		case FRAME_PAREN: {
+			if (!Expect(lexer, TT_RPAREN, "Expected ')' to end "
+						"parenthesized expression"))
+				goto fail;
+
+			// A shared node keeps the first location it is seen at
+			if (!(lhs->flags & EXPR_SHARED) || 
+					frame->token->offset < lhs->loc.offset)
+				lhs->loc.offset = frame->token->offset;
+			break;
+		}
+
+		case FRAME_CALL: {
+			if (frame->nargs++)
+				DeleteExpr(lhs);
+			else
+				frame->arg = lhs;
+
+			lhs = NULL;
+			token = Peek(lexer);
+			if (token->type == TT_RPAREN) {
+				Next(lexer);
+				goto parse_cast;
+			}
+
+			else if (token->type == TT_COMMA) {
+				Next(lexer);
+				token = Peek(lexer);
+				if (token->type == TT_RPAREN) {
+					ParserError(lexer, token, 
+						"Parameters expected after ','");
+					goto fail_call;
+				}
+
+				goto parse_argument;
+			}
+
+			ParserError(lexer, token, "Expected ','/'')' here");
+			goto fail_call;
+		}
+	}
+
+	minbp = frame->minbp;
+	stack.size--;
+	goto parse_infix;
+
+parse_argument:
+	frame->start = Peek(lexer);
+	minbp = 0;
+	goto parse_predicate;
+
+parse_cast:
+	if (frame->nargs != 1) {
+		ParserError(lexer, frame->token, "Only 1 argument is needed");
+		goto fail_call;
 	}
 
+	lhs = makeExpr(lexer->arena, ET_CAST);
+	lhs->cast = Allocate(lexer->arena, sizeof(Cast));
+	lhs->cast->target = frame->target;
+	lhs->cast->expr = frame->arg;
+	lhs->loc.offset = frame->token->offset;
+	lhs = Share(lexer, lhs);
+
+	minbp = frame->minbp;
+	stack.size--;
+	goto parse_infix;
+
+fail_call:
+	DeleteFrame(lexer, frame, 1);
+	stack.size--;
+
+fail:
+	DeleteExpr(lhs);
+	lhs = NULL;
+	while (stack.size)
+		DeleteFrame(lexer, &stack.data[--stack.size], 0);
+
+done:
+	DeleteFrameStack(&stack);
+
 	return lhs;
 }
-
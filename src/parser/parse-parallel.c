@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parser.h"
+
+/* Parses the top level statements of a lexed file on several threads. One
+ * pass over the token types finds where top level statements end, which is
+ * at a ';' or a '}' outside of any braces, and the tokens are cut into
+ * chunks of whole statements there. Every chunk is parsed by its own copy of
+ * the lexer, with its own cursor, into its own Vector of statements, and the
+ * vectors are joined in order.
+ *
+ * The parser keeps no state from one statement to the next, so a chunk
+ * parses exactly as it would after the chunks before it. When a statement
+ * fails to parse, or runs past the end of its chunk, it and everything after
+ * it is thrown away and left to the caller to parse again on one thread,
+ * which reports the error just like it would without threads. The chunks
+ * are parsed with LEXER_QUIET for that reason.
+ *
+ * An ExprPool is not safe to share between threads, so a lexer with one is
+ * left to the caller to parse on one thread. Neither is an arena, so every
+ * chunk allocates from its own, which Lexer.arena adopts in the end */
+
+#define PARSER_CHUNK_MIN (64 * 1024) // fewer tokens are not worth a thread
+#define PARSER_THREADS_MAX 64
+
+typedef struct ParseChunk {
+	Lexer    lexer;   // a copy of the lexer, with Lexer.cursor at the start
+	uint32_t end;     // index of the token after the last statement
+	uint32_t resume;  // index of the first token of the statement that failed
+	Vector*  stats;
+	Arena    arena;
+	int      failed;
+	pthread_t thread;
+} ParseChunk;
+
+static void* ParseChunkStatements(void* arg) {
+	ParseChunk* chunk = arg;
+	Lexer* lexer = &chunk->lexer;
+
+	while (lexer->cursor < chunk->end) {
+		chunk->resume = lexer->cursor;
+		Statement* stat = ParseStatement(lexer);
+		if (!stat || lexer->cursor > chunk->end || 
+				!Append(chunk->stats, stat)) {
+			if (!lexer->arena)
+				DeleteStatement(stat);
+
+			chunk->failed = 1;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static uint32_t Threads(uint32_t threads, uint32_t ntokens) {
+	if (!threads) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 0 ? cores : 1;
+	}
+
+	if (threads > ntokens / PARSER_CHUNK_MIN)
+		threads = ntokens / PARSER_CHUNK_MIN;
+
+	return threads > PARSER_THREADS_MAX ? PARSER_THREADS_MAX : threads;
+}
+
+/* Cuts [start, end) into at most nchunks chunks of about the same number of
+ * tokens, each ending after a top level statement. Returns the number of
+ * chunks, whose ends are written to cuts */
+static uint32_t FindCuts(Token* tokens, uint32_t start, uint32_t end,
+		uint32_t nchunks, uint32_t* cuts) {
+	uint32_t ncuts = 0, depth = 0;
+	uint64_t target = start + (uint64_t) (end - start) / nchunks;
+
+	for (uint32_t i = start; i < end && ncuts + 1 < nchunks; i++) {
+		TokenType type = tokens[i].type;
+		if (type == TT_LCURLY)
+			depth++;
+		else if (type == TT_RCURLY && depth)
+			depth--;
+		else if (type != TT_SEMICOLON || depth)
+			continue;
+
+		if (depth || i + 1 < target)
+			continue;
+
+		cuts[ncuts++] = i + 1;
+		target = start + (uint64_t) (end - start) * (ncuts + 1) / nchunks;
+	}
+
+	cuts[ncuts++] = end;
+	return ncuts;
+}
+
+uint32_t ParseParallel(Lexer* lexer, Vector* stats, uint32_t threads) {
+	if (!(lexer->flags & LEXER_BATCH) || lexer->pool)
+		return 0;
+
+	uint32_t start = lexer->cursor;
+	uint32_t end = lexer->ntokens - 1; // TT_EOF is left to the caller
+	if (start >= end)
+		return 0;
+
+	threads = Threads(threads, end - start);
+	if (threads < 2)
+		return 0;
+
+	ParseChunk* chunks = calloc(threads, sizeof(ParseChunk));
+	uint32_t* cuts = malloc(threads * sizeof(uint32_t));
+	if (!chunks || !cuts) {
+		free(chunks);
+		free(cuts);
+		return 0;
+	}
+
+	uint32_t nchunks = FindCuts(lexer->tokens, start, end, threads, cuts);
+	for (uint32_t i = 0; i < nchunks; i++) {
+		ParseChunk* chunk = &chunks[i];
+		chunk->lexer = *lexer;
+		chunk->lexer.flags |= LEXER_QUIET;
+		chunk->lexer.lines = NULL;
+		chunk->lexer.nlines = 0;
+		chunk->lexer.cursor = i ? cuts[i - 1] : start;
+		chunk->end = cuts[i];
+		chunk->stats = NewVector();
+		if (lexer->arena) {
+			InitArena(&chunk->arena, lexer->arena->flags);
+			chunk->lexer.arena = &chunk->arena;
+		}
+	}
+
+	uint32_t spawned = 1;
+	for (; spawned < nchunks; spawned++) {
+		ParseChunk* chunk = &chunks[spawned];
+		if (pthread_create(&chunk->thread, NULL, ParseChunkStatements, chunk))
+			break;
+	}
+
+	ParseChunkStatements(&chunks[0]);
+	for (uint32_t i = spawned; i < nchunks; i++)
+		ParseChunkStatements(&chunks[i]);
+
+	for (uint32_t i = 1; i < spawned; i++)
+		pthread_join(chunks[i].thread, NULL);
+
+	// Everything up to the statement that failed first is kept
+	uint32_t count = 0, failed = 0, length = VectorLength(stats);
+	int lost = 0; // stats ran out of memory
+	for (uint32_t i = 0; i < nchunks; i++) {
+		ParseChunk* chunk = &chunks[i];
+		for (uint32_t j = 0; j < VectorLength(chunk->stats); j++) {
+			Statement* stat = Get(chunk->stats, j);
+			int kept = !failed && !lost && Append(stats, stat);
+			lost |= !failed && !kept;
+			if (!kept && !lexer->arena)
+				DeleteStatement(stat);
+		}
+
+		if (!failed) {
+			count += VectorLength(chunk->stats);
+			lexer->cursor = (chunk->failed) ? chunk->resume : chunk->end;
+		}
+
+		failed |= chunk->failed;
+		DeleteVector(chunk->stats);
+		if (lexer->arena)
+			ArenaAdopt(lexer->arena, &chunk->arena);
+	}
+
+	free(chunks);
+	free(cuts);
+
+	// Without all of them in stats, the caller parses them all again
+	if (lost) {
+		while (VectorLength(stats) > length) {
+			Statement* stat = Pop(stats);
+			if (!lexer->arena)
+				DeleteStatement(stat);
+		}
+
+		lexer->cursor = start;
+		return 0;
+	}
+
+	return count;
+}
@@ -38,12 +38,14 @@ OperatorCode OpToBinop(TokenType type) {
 	return OP_BINARY_MAX; // unreachable
 }
 
-Expr* makeExpr(enum ExprType type) {
-	Expr* expr = malloc(sizeof(Expr));
+Expr* makeExpr(Arena* arena, enum ExprType type) {
+	Expr* expr = Allocate(arena, sizeof(Expr));
 	if (!expr)
 		return NULL;
 
 	expr->type = type;
+	expr->flags = (arena) ? EXPR_ARENA : 0;
+	expr->rtype = NULL;
 	return expr;
 }
 
@@ -54,20 +56,26 @@ void DumpStatement(Statement* stat) {
 		if (stat->vardecl->init)
 			DumpExpr(stat->vardecl->init);
 		else {
-			printf("%s ", stat->vardecl->ident);
+			printf("%s ", NameText(stat->vardecl->ident));
 			printf("= ");
 			printf("no-init ");
 		}
 
 		if (stat->vardecl->type)
-			printf("%s ", stat->vardecl->type);
+			printf("%s ", NameText(stat->vardecl->type));
 	}
 
 	else if (stat->type == ST_FUNCTION) {
-		printf("function %s ", stat->func->name);
+		printf("function %s ", NameText(stat->func->name));
 		printf("(%d params) ", VectorLength(stat->func->args));
 		if (stat->func->rtype) 
-			printf("-> %s ", stat->func->rtype);
+			printf("-> %s ", NameText(stat->func->rtype));
+
+		// A body that was skipped is only dumped as its size
+		if (!stat->func->statements) {
+			printf(" { %u tokens }", stat->func->body_end - stat->func->body);
+			return;
+		}
 
 		printf(" {\n");
 		for (uint32_t i = 0; i < VectorLength(stat->func->statements); i++) {
@@ -83,45 +91,158 @@ void DumpStatement(Statement* stat) {
 	
 }
 
+static int PushVisit(ExprWalk* walk, Expr* expr) {
+	ExprVisit* visit = PushExprVisitStack(&walk->stack);
+	if (!visit) {
+		walk->failed = 1;
+		return 0;
+	}
+
+	visit->expr = expr;
+	visit->expanded = 0;
+	return 1;
+}
+
+void BeginExprWalk(ExprWalk* walk, Expr* root) {
+	InitExprVisitStack(&walk->stack);
+	walk->failed = 0;
+	walk->leaves = 0;
+	if (root)
+		PushVisit(walk, root);
+}
+
+Expr* NextExpr(ExprWalk* walk) {
+	while (walk->stack.size && !walk->failed) {
+		ExprVisit* top = ExprVisitStackAt(&walk->stack, walk->stack.size - 1);
+		Expr* expr = top->expr;
+		if (top->expanded) {
+			walk->stack.size--;
+			return expr;
+		}
+
+		// The right operand is pushed first, so that the left one comes out
+		// first, and top is not used past here as the stack may move
+		top->expanded = 1;
+		if (expr->flags & walk->leaves)
+			continue;
+
+		switch (expr->type) {
+			case ET_UNARY_OP: PushVisit(walk, expr->unop->operand); break;
+			case ET_CAST: PushVisit(walk, expr->cast->expr); break;
+			case ET_BINARY_OP: {
+				if (PushVisit(walk, expr->binop->right))
+					PushVisit(walk, expr->binop->left);
+				break;
+			}
+			default: break;
+		}
+	}
+
+	return NULL;
+}
+
+void EndExprWalk(ExprWalk* walk) {
+	DeleteExprVisitStack(&walk->stack);
+}
+
 void DumpExpr(Expr* expr) {
-	if (expr->type == ET_INT_LITERAL)
-		printf("%d ", expr->literal->number);
-	else if (expr->type == ET_IDENT)
-		printf("%s ", expr->ident);
-	else if (expr->type == ET_UNARY_OP) {
-		DumpExpr(expr->unop->operand);
-		printf("%s ", Operator2String(expr->unop->type));
+	ExprWalk walk;
+	BeginExprWalk(&walk, expr);
+
+	while ((expr = NextExpr(&walk))) {
+		if (expr->type == ET_INT_LITERAL) {
+			PrintLiteral(expr->literal->type, expr->literal->number);
+			printf(" ");
+		} else if (expr->type == ET_IDENT)
+			printf("%s ", NameText(expr->ident));
+		else if (expr->type == ET_UNARY_OP)
+			printf("%s ", Operator2String(expr->unop->type));
+		else if (expr->type == ET_BINARY_OP)
+			printf("%s ", Operator2String(expr->binop->type)); 
+		else if (expr->type == ET_CAST)
+			printf("(%s)", expr->cast->target->name);
 	}
-	else if (expr->type == ET_BINARY_OP) {
-		DumpExpr(expr->binop->left);
-		DumpExpr(expr->binop->right);
-		printf("%s ", Operator2String(expr->binop->type)); 
+
+	EndExprWalk(&walk);
+}
+
+// Frees a node, but not its operands
+void DeleteExprNode(Expr* expr) {
+	if (expr->flags & EXPR_ARENA)
+		return;
+
+	if (expr->type == ET_INT_LITERAL)
+		free(expr->literal);
+	else if (expr->type == ET_UNARY_OP)
+		free(expr->unop);
+	else if (expr->type == ET_BINARY_OP)
+		free(expr->binop);
+	else if (expr->type == ET_CAST)
+		free(expr->cast);
+
+	free(expr);
+}
+
+// The operands of a node come out of the walk before it, so freeing it then
+// is safe. Shared nodes belong to their ExprPool and are left alone, like
+// the ones in an arena
+void DeleteExpr(Expr* expr) {
+	ExprWalk walk;
+	BeginExprWalk(&walk, expr);
+	walk.leaves = EXPR_SHARED | EXPR_ARENA;
+
+	while ((expr = NextExpr(&walk)))
+		if (!(expr->flags & EXPR_SHARED))
+			DeleteExprNode(expr);
+
+	EndExprWalk(&walk);
+}
+
+void DeleteStatement(Statement* stat) {
+	if (!stat)
+		return;
+
+	if (stat->type == ST_EXPR)
+		DeleteExpr(stat->expr);
+	else if (stat->type == ST_VARDECL) {
+		DeleteExpr(stat->vardecl->init);
+		free(stat->vardecl);
 	}
-	else if (expr->type == ET_CAST) {
-		DumpExpr(expr->cast->expr);
-		printf("(%s)", expr->cast->target->name);
+	else if (stat->type == ST_FUNCTION) {
+		for (uint32_t i = 0; i < VectorLength(stat->func->args); i++) {
+			FuncArgs* arg = Get(stat->func->args, i);
+			free(arg);
+		}
+
+		Vector* body = stat->func->statements;
+		for (uint32_t i = 0; body && i < VectorLength(body); i++)
+			DeleteStatement(Get(body, i));
+
+		DeleteVector(stat->func->args);
+		DeleteVector(stat->func->statements);
+		free(stat->func);
 	}
+
+	free(stat);
 }
 
 void ParserError(Lexer* lexer, Token* token, const char* msg) {
-	printf("%s:%u:%u\nError: %s\n", lexer->file, token->line, 
-			token->pos, msg);
-	
-	LineExtent* le = Get(lexer->extent, token->line - 1);
-	if (le == INVALID_INDEX)
+	if (lexer->flags & LEXER_QUIET)
 		return;
 
-	char* source = lexer->source + le->offset;
-	// If line length is not known, assume it ends where the token ends
-	if (!le->length) 
-		le->length = token->offset - le->offset + token->length;
+	LineInfo li = LexerLocate(lexer, token->offset);
+	printf("%s:%u:%u\nError: %s\n", lexer->file, li.line, li.pos, msg);
 
-	char* line = malloc(sizeof(char) * (le->length + 1));
-	memcpy(line, source, le->length);
-	line[le->length] = '\0';
+	if (!li.text)
+		return; // we no longer have the source of this line
+
+	const char* source = li.text;
+	char* line = malloc(sizeof(char) * (li.length + 1));
+	memcpy(line, source, li.length);
+	line[li.length] = '\0';
 
 	printf("%s\n", line);
-	for (uint32_t i = 0; i < token->pos - 1; i++) { printf(" "); }
+	for (uint32_t i = 0; i < li.pos - 1; i++) { printf(" "); }
 	printf("^\n");
 	free(line);
 }
@@ -135,42 +256,26 @@ int Expect(Lexer* lexer, TokenType type, const char* msg) {
 	return 0;
 }
 
-int ToDecimal(int digit, int base) {
-	if (digit < 0)
-		return -1;
+#define XX 0xff
 
-	if (base == 2) {
-		if (digit < 2)
-			return digit;
-		else
-			return -1;
-	}
+// 0xff (XX) for every byte that is not a digit in any base
+const uint8_t DIGIT_VALUES[256] = {
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
 
-	else if (base == 8) {
-		if (digit < 8)
-			return digit;
-		else
-			return -1;
-	}
-
-	else if (base == 10) {
-		if (digit < 10)
-			return digit;
-		else
-			return -1;
-	}
-
-	else { // base = 16
-		switch (digit) {
-			case 0: case 1: case 2: case 3: case 4: case 5: case 6:
-			case 7: case 8: case 9: return digit;
-			case 'A' - '0': case 'a' - '0': return 10;
-			case 'B' - '0': case 'b' - '0': return 11;
-			case 'C' - '0': case 'c' - '0': return 12;
-			case 'D' - '0': case 'd' - '0': return 13;
-			case 'E' - '0': case 'e' - '0': return 14;
-			case 'F' - '0': case 'f' - '0': return 15;
-			default: return -1;
-		}
-	}
-}
+#undef XX
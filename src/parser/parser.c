@@ -2,89 +2,156 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "parser-utils.h"
 #include "parse-expr.h"
 
-Type* ParseLiteralSuffix(char* source, uint32_t len) {
-	for (int i = 0; i < len_builtins; i++) {
-		Type* ty = BUILTIN_TYPES[i];
-		if (strncmp(source, ty->name, len) == 0)
-			return ty;
+// Recognises the suffixes i8 to u64 from their characters
+Type* ParseLiteralSuffix(const char* source, uint32_t len) {
+	int sign, size = -1;
+	switch (source[0]) {
+		case 'i': sign = 0; break;
+		case 'u': sign = 4; break;
+		default: return NULL;
 	}
 
-	return NULL;
+	if (len == 2 && source[1] == '8')
+		size = 0;
+	else if (len == 3) {
+		switch (source[1] << 8 | source[2]) {
+			case '1' << 8 | '6': size = 1; break;
+			case '3' << 8 | '2': size = 2; break;
+			case '6' << 8 | '4': size = 3; break;
+		}
+	}
+
+	// BUILTIN_TYPES goes i8 to i64 and then u8 to u64
+	return (size < 0) ? NULL : BUILTIN_TYPES[sign + size];
 }
 
-int ParseIntLiteral(Lexer* lexer, Token* token, Expr* expr) {
-	char* source = lexer->source + token->offset;
-	int base = 10;
+#define ONES 0x0101010101010101ull
 
-	expr->literal = malloc(sizeof(IntLiteral));
-	
-	if (*source == '0') { 
-		if (token->length == 1) {
-			expr->literal->type = I32();
-			expr->literal->number = 0;
-			return 1;
-		}
+// The 8 bytes at source, with the first one in the low byte
+static inline uint64_t Load64(const char* source) {
+	uint64_t v;
+	memcpy(&v, source, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+/* Checks that all 8 bytes in v are digits of base. The lexer only puts
+ * letters, digits, '_' and bytes above 0x7f in a number, so once the latter
+ * are ruled out, every byte is at least '0' and nothing borrows or carries
+ * into the next byte */
+static inline int AllDigits64(uint64_t v, uint64_t base) {
+	if (v & ONES * 0x80)
+		return 0;
+
+	uint64_t bad = (v - ONES * '0' + ONES * (0x80 - ((base < 10) ? base : 10)))
+		& ONES * 0x80;
+	if (base == 16) {
+		uint64_t lower = v | ONES * 0x20;
+		uint64_t letter = (lower + ONES * (0x80 - 'a')) 
+			& ~(lower + ONES * (0x80 - 'g')) & ONES * 0x80;
+		bad &= ~letter;
+	}
 
-		source++;
-		switch (*source) {
-			case 'b': case 'B' : base = 2; token->length -= 2;  break;
-			case 'x': case 'X' : base = 16; token->length -= 2; break;
+	return bad == 0;
+}
+
+/* The value of the 8 digits of base in v, the first digit being the most
+ * significant. Neighbouring digits are merged into pairs, then quads and
+ * then all 8 of them, with one multiply each */
+static inline uint64_t Digits64(uint64_t v, uint64_t base) {
+	if (base == 16) // the letters have 0x40 set, and 'a' - 1 is 0x60
+		v += (v >> 6 & ONES) * 9;
+
+	uint64_t base2 = base * base;
+	v &= ONES * 0x0f;
+	v = (v * (base * 0x100 + 1)) >> 8 & 0x00ff00ff00ff00ffull;
+	v = (v * (base2 * 0x10000 + 1)) >> 16 & 0x0000ffff0000ffffull;
+	return (v * ((base2 * base2 << 32) + 1)) >> 32;
+}
+
+/* A literal is digits of a base, given by a 0b, 0x or 0 prefix, followed by
+ * an optional type suffix. negated is set for a literal right after a '-',
+ * which may then be one past the maximum of a signed type */
+int ParseIntLiteral(Lexer* lexer, Token* token, Expr* expr, int negated) {
+	const char* source = TokenText(lexer, token);
+	const char* end = source + token->length;
+	uint64_t base = 10;
+
+	expr->literal = Allocate(lexer->arena, sizeof(IntLiteral));
+
+	if (*source == '0' && token->length > 1) {
+		switch (source[1]) {
+			case 'b': case 'B': base = 2; source += 2; break;
+			case 'x': case 'X': base = 16; source += 2; break;
 			default: {
-				if (isdigit(*source)) {
-					// move source back, so that the later source++ puts us
-					// back in the same place
-					source--;
+				if (DIGIT_VALUES[(uint8_t) source[1]] < 10) {
 					base = 8;
-					token->length -= 1;
-				}
-				else {
-					ParserError(lexer, token, "Invalid base specifier"
-							" in integer literal");
-					return 0;
+					source++;
 				}
 			}
 		}
-		source++;
 	}
 
-	int64_t literal = 0;
-	Type* type = NULL;
-
-	for (uint32_t idx = 0; idx < token->length; idx++) {
-		int d = ToDecimal(*source - '0', base);
-		if (d == -1) {
-			uint32_t diff = token->length - idx;
-			if (diff > 1 && diff < 4) {
-				type = ParseLiteralSuffix(source, diff);
-				if (type) 
-					break;
-			}
+	const char* digits = source;
+	uint64_t literal = 0;
+	uint64_t scale = base * base * base * base;
+	int overflow = 0;
 
+	scale *= scale;
+	while (end - source >= 8) {
+		uint64_t v = Load64(source);
+		if (!AllDigits64(v, base))
+			break;
+
+		overflow |= __builtin_mul_overflow(literal, scale, &literal);
+		overflow |= __builtin_add_overflow(literal, Digits64(v, base), &literal);
+		source += 8;
+	}
+
+	for (; source < end; source++) {
+		uint64_t d = DIGIT_VALUES[(uint8_t) *source];
+		if (d >= base)
+			break;
+
+		overflow |= __builtin_mul_overflow(literal, base, &literal);
+		overflow |= __builtin_add_overflow(literal, d, &literal);
+	}
+
+	Type* type = I32();
+	if (source < end) {
+		type = ParseLiteralSuffix(source, end - source);
+		if (!type) {
 			ParserError(lexer, token, "Non-digit present in number literal");
 			return 0;
 		}
+	}
 
-		literal = literal * base + d;
-		source++;
+	if (source == digits) { // 0x and 0b without any digits
+		ParserError(lexer, token, "Expected digits in integer literal");
+		return 0;
 	}
 
-	expr->literal->type = (type) ? type : I32();
+	if (overflow || !TypeFitsLiteral(type, literal, negated)) {
+		ParserError(lexer, token, "Integer literal is out of the range "
+				"of its type");
+		return 0;
+	}
+
+	expr->literal->type = type;
 	expr->literal->number = literal;
 	return 1;
 }
 
+// The lexer has hashed the name already
 int ParseIdent(Lexer* lexer, Token* token, Expr* expr) {
-	expr->ident = malloc(sizeof(char) * (token->length + 1));
-	if (!expr->ident)
-		return 0;
-
-	memcpy(expr->ident, lexer->source + token->offset, token->length);
-	expr->ident[token->length] = '\0';
-	return 1;
+	expr->ident = InternName(TokenText(lexer, token), token->length, 
+			token->hash);
+	return expr->ident != 0;
 }
 
 
@@ -101,8 +168,7 @@ int ParseVarDecl(Lexer* lexer, Statement* stat) {
 		return 0;
 	}
 
-	stat->loc.line = token->line;
-	stat->loc.pos = token->pos;
+	stat->loc.offset = token->offset;
 
 	Next(lexer);
 
@@ -125,7 +191,7 @@ int ParseVarDecl(Lexer* lexer, Statement* stat) {
 		return 0;
 	}
 
-	Expr* expr = (op->type == TT_SEMICOLON) ? NULL : makeExpr(ET_IDENT);
+	Expr* expr = (op->type == TT_SEMICOLON) ? NULL : makeExpr(lexer->arena, ET_IDENT);
 	if (!expr) {
 		if (!ty) {
 			ParserError(lexer, token, "Variables without an initializer "
@@ -139,15 +205,16 @@ int ParseVarDecl(Lexer* lexer, Statement* stat) {
 	if (!ParseIdent(lexer, token, expr))
 		return 0;
 
+	expr->loc.offset = token->offset;
 	expr = ParseExpression(lexer, expr);
 	if (!expr)
 		return 0;
 
 no_init:
-	stat->vardecl = malloc(sizeof(VarDecl));
+	stat->vardecl = Allocate(lexer->arena, sizeof(VarDecl));
 	stat->vardecl->init = expr;
-	stat->vardecl->loc.line = token->line;
-	stat->vardecl->loc.pos = token->pos;
+	stat->vardecl->loc.offset = token->offset;
+	stat->vardecl->sym = NULL;
 
 	// Trick ParseIdent into parsing these for us
 	Expr tmp;
@@ -156,11 +223,72 @@ no_init:
 	if (ty) {
 		ParseIdent(lexer, ty, &tmp);
 		stat->vardecl->type = tmp.ident;
-		stat->vardecl->loc_type.line = ty->line;
-		stat->vardecl->loc_type.pos = ty->pos;
+		stat->vardecl->loc_type.offset = ty->offset;
 	} else
-		stat->vardecl->type = NULL;
+		stat->vardecl->type = 0;
+
+	return 1;
+}
+
+// Parses statements up to the '}' that ends a function, and past it
+static Vector* ParseBody(Lexer* lexer, Function* func) {
+	Vector* statements = NewVector();
+	while (1) {
+		Token* next = Peek(lexer);
+		if (next->type == TT_RCURLY) {
+			func->close.offset = next->offset;
+			func->body_end = lexer->cursor;
+			Next(lexer);
+			break;
+		}
+
+		if (next->type == TT_EOF) {
+			ParserError(lexer, next, "Expected '}' to terminate function");
+			goto fail;
+		}
+
+		Statement* funcstat = ParseStatement(lexer);
+		if (!funcstat)
+			goto fail;
+
+		if (!Append(statements, funcstat)) {
+			if (!lexer->arena)
+				DeleteStatement(funcstat);
+			goto fail;
+		}
+	}
+
+	return statements;
+
+fail:
+	for (uint32_t i = 0; !lexer->arena && i < VectorLength(statements); i++)
+		DeleteStatement(Get(statements, i));
+
+	DeleteVector(statements);
+	return NULL;
+}
 
+// Moves past the '}' that matches the '{' before the cursor
+static int SkipBody(Lexer* lexer, Function* func) {
+	Token* tokens = lexer->tokens;
+	uint32_t depth = 1, cursor = lexer->cursor;
+
+	for (; tokens[cursor].type != TT_EOF; cursor++) {
+		if (tokens[cursor].type == TT_LCURLY)
+			depth++;
+		else if (tokens[cursor].type == TT_RCURLY && !--depth)
+			break;
+	}
+
+	lexer->cursor = cursor;
+	if (tokens[cursor].type == TT_EOF) {
+		ParserError(lexer, &tokens[cursor], "Expected '}' to terminate function");
+		return 0;
+	}
+
+	func->close.offset = tokens[cursor].offset;
+	func->body_end = cursor;
+	Next(lexer);
 	return 1;
 }
 
@@ -178,7 +306,7 @@ int ParseFunction(Lexer* lexer, Statement* stat) {
 	}
 
 	stat->type = ST_FUNCTION;
-	stat->func = malloc(sizeof(Function));
+	stat->func = Allocate(lexer->arena, sizeof(Function));
 	if (!stat->func)
 		return 0;
 
@@ -209,7 +337,7 @@ parse_next_param:
 			return 0;
 		}
 
-		FuncArgs* fnargs = malloc(sizeof(FuncArgs));
+		FuncArgs* fnargs = Allocate(lexer->arena, sizeof(FuncArgs));
 		if (!fnargs)
 			return 0;
 
@@ -229,7 +357,11 @@ parse_next_param:
 
 		ParseIdent(lexer, token, &tmp);
 		fnargs->type = tmp.ident;
-		Append(stat->func->args, fnargs);
+		if (!Append(stat->func->args, fnargs)) {
+			if (!lexer->arena)
+				free(fnargs);
+			return 0;
+		}
 
 		more_params = 0;
 
@@ -266,7 +398,7 @@ parse_return_type:
 	}
 
 	else if (ret->type == TT_LCURLY) {
-		stat->func->rtype = NULL;
+		stat->func->rtype = 0;
 		Next(lexer);
 		goto parse_statements;
 	}
@@ -277,33 +409,36 @@ parse_return_type:
 	}
 
 	if (stat->func->rtype) {
+		ret = Peek(lexer);
 		if (!Expect(lexer, TT_LCURLY, "Expected '{' here"))
 			return 0;
 	}
 
 parse_statements:
 
-	stat->func->statements = NewVector();
-	while (1) {
-		Token* next = Peek(lexer);
-		if (next->type == TT_RCURLY) {
-			Next(lexer);
-			break;
-		}
+	stat->func->statements = NULL;
+	stat->func->body = lexer->cursor;
+	stat->func->open.offset = ret->offset;
 
-		if (next->type == TT_EOF) {
-			ParserError(lexer, next, "Expected '}' to terminate function");
-			return 0;
-		}
+	// In batch mode the body can be found again later, so only its braces 
+	// have to be matched for now
+	if ((lexer->flags & (LEXER_LAZY | LEXER_BATCH)) == 
+			(LEXER_LAZY | LEXER_BATCH))
+		return SkipBody(lexer, stat->func);
 
-		Statement* funcstat = ParseStatement(lexer);
-		if (!funcstat)
-			return 0;
+	stat->func->statements = ParseBody(lexer, stat->func);
+	return stat->func->statements != NULL;
+}
 
-		Append(stat->func->statements, funcstat);
-	}
+Vector* FunctionBody(Lexer* lexer, Function* func) {
+	if (func->statements)
+		return func->statements;
 
-	return 1;
+	uint32_t cursor = lexer->cursor;
+	lexer->cursor = func->body;
+	func->statements = ParseBody(lexer, func);
+	lexer->cursor = cursor;
+	return func->statements;
 }
 
 /* 
@@ -319,7 +454,7 @@ Statement* ParseStatement(Lexer* lexer) {
 		return NULL;
 	}
 
-	Statement* stat = malloc(sizeof(Statement));
+	Statement* stat = Allocate(lexer->arena, sizeof(Statement));
 	if (!stat)
 		return NULL;
 
@@ -334,6 +469,7 @@ Statement* ParseStatement(Lexer* lexer) {
 		}
 
 		case TT_FUNCTION: {
+			stat->loc.offset = token->offset;
 			Next(lexer);
 			if (!ParseFunction(lexer, stat))
 				return NULL;
@@ -343,8 +479,7 @@ Statement* ParseStatement(Lexer* lexer) {
 		}
 
 		default: {
-			stat->loc.line = token->line;
-			stat->loc.pos = token->pos;
+			stat->loc.offset = token->offset;
 
 			Expr* expr = ParseExpression(lexer, NULL);
 			if (!expr) 
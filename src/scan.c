@@ -0,0 +1,416 @@
+#include <stddef.h>
+#include "scan.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#define D CC_DIGIT
+#define A CC_ALPHA
+#define S CC_SPACE
+
+const uint8_t CHAR_CLASS[256] = {
+	['\t'] = S, ['\n'] = S, ['\v'] = S, ['\f'] = S, ['\r'] = S, [' '] = S,
+
+	['0'] = D, ['1'] = D, ['2'] = D, ['3'] = D, ['4'] = D, 
+	['5'] = D, ['6'] = D, ['7'] = D, ['8'] = D, ['9'] = D,
+
+	['a'] = A, ['b'] = A, ['c'] = A, ['d'] = A, ['e'] = A, ['f'] = A, 
+	['g'] = A, ['h'] = A, ['i'] = A, ['j'] = A, ['k'] = A, ['l'] = A, 
+	['m'] = A, ['n'] = A, ['o'] = A, ['p'] = A, ['q'] = A, ['r'] = A, 
+	['s'] = A, ['t'] = A, ['u'] = A, ['v'] = A, ['w'] = A, ['x'] = A, 
+	['y'] = A, ['z'] = A,
+
+	['A'] = A, ['B'] = A, ['C'] = A, ['D'] = A, ['E'] = A, ['F'] = A, 
+	['G'] = A, ['H'] = A, ['I'] = A, ['J'] = A, ['K'] = A, ['L'] = A, 
+	['M'] = A, ['N'] = A, ['O'] = A, ['P'] = A, ['Q'] = A, ['R'] = A, 
+	['S'] = A, ['T'] = A, ['U'] = A, ['V'] = A, ['W'] = A, ['X'] = A, 
+	['Y'] = A, ['Z'] = A,
+};
+
+#undef D
+#undef A
+#undef S
+
+static uint32_t ScalarAlnum(const char* source, uint32_t offset, 
+		uint32_t size) {
+	while (offset < size && IsAlnum(source[offset]))
+		offset++;
+
+	return offset;
+}
+
+static uint32_t ScalarSpace(const char* source, uint32_t offset, 
+		uint32_t size) {
+	while (offset < size && IsSpace(source[offset]))
+		offset++;
+
+	return offset;
+}
+
+static uint32_t ScalarLine(const char* source, uint32_t offset, 
+		uint32_t size) {
+	while (offset < size && source[offset] != '\n')
+		offset++;
+
+	return offset;
+}
+
+// Returns the offset of the first byte that is not part of a well formed 
+// UTF-8 sequence, rejecting overlong forms, surrogates and code points 
+// past U+10FFFF
+static uint32_t ScalarUTF8(const char* source, uint32_t offset, 
+		uint32_t size) {
+	const uint8_t* s = (const uint8_t*) source;
+	while (offset < size) {
+		uint8_t c = s[offset];
+		if (c < 0x80) {
+			offset++;
+			continue;
+		}
+
+		// The valid range of the second byte depends on the first, the 
+		// bytes after that are always 0x80-0xbf
+		uint32_t len;
+		uint8_t lo = 0x80, hi = 0xbf;
+		if (c >= 0xc2 && c <= 0xdf)
+			len = 2;
+		else if (c >= 0xe0 && c <= 0xef) {
+			len = 3;
+			lo = (c == 0xe0) ? 0xa0 : 0x80; // overlong
+			hi = (c == 0xed) ? 0x9f : 0xbf; // surrogates
+		} else if (c >= 0xf0 && c <= 0xf4) {
+			len = 4;
+			lo = (c == 0xf0) ? 0x90 : 0x80; // overlong
+			hi = (c == 0xf4) ? 0x8f : 0xbf; // past U+10FFFF
+		} else
+			return offset;
+
+		if (size - offset < len || s[offset + 1] < lo || s[offset + 1] > hi)
+			return offset;
+
+		for (uint32_t i = 2; i < len; i++) {
+			if ((s[offset + i] & 0xc0) != 0x80)
+				return offset;
+		}
+
+		offset += len;
+	}
+
+	return offset;
+}
+
+#ifdef SCAN_X86
+
+/* Each of the kernels below builds a mask of the bytes that are still part 
+ * of the run, and stops at the first clear bit. Only whole vectors that lie
+ * within the source are loaded, the tail is left to the scalar loop so 
+ * that we never read past the end of the mapping */
+
+static inline __m128i AlnumMask128(__m128i v) {
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(
+			_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+	return _mm_or_si128(digit, alpha);
+}
+
+// '\t', '\n', '\v', '\f' and '\r' are the contiguous range 9-13
+static inline __m128i SpaceMask128(__m128i v) {
+	__m128i ctrl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+	return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), ctrl);
+}
+
+static inline __m128i LineMask128(__m128i v) {
+	// Everything that is not a newline continues the run
+	return _mm_xor_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), 
+			_mm_set1_epi8(-1));
+}
+
+#define DEFINE_SSE2_SCANNER(name, mask, scalar)                           \
+static uint32_t name(const char* source, uint32_t offset, uint32_t size) { \
+	while (offset + 16 <= size) {                                          \
+		__m128i v = _mm_loadu_si128((const __m128i*) (source + offset));   \
+		uint32_t stop = ~_mm_movemask_epi8(mask(v)) & 0xffff;              \
+		if (stop)                                                          \
+			return offset + __builtin_ctz(stop);                           \
+		offset += 16;                                                      \
+	}                                                                      \
+	return scalar(source, offset, size);                                   \
+}
+
+DEFINE_SSE2_SCANNER(SSE2Alnum, AlnumMask128, ScalarAlnum)
+DEFINE_SSE2_SCANNER(SSE2Space, SpaceMask128, ScalarSpace)
+DEFINE_SSE2_SCANNER(SSE2Line, LineMask128, ScalarLine)
+
+/* UTF-8 validation, after the lookup algorithm of simdjson (Keiser and 
+ * Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"). The 
+ * high and low nibble of every byte and the high nibble of the byte after
+ * it are each looked up in a table of the errors that they could be part 
+ * of, and an error is only real if all three agree. What is left, a lead 
+ * byte that is not followed by enough continuation bytes or the other way
+ * around, is checked by comparing with the bytes 2 and 3 back.
+ *
+ * The vectors only tell us that there is an error somewhere, the scalar 
+ * validator then finds it. It also deals with the tail of the source */
+
+#define UTF8_TOO_SHORT  (1 << 0) // a lead byte followed by a non continuation
+#define UTF8_TOO_LONG   (1 << 1) // ASCII followed by a continuation
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE  (1 << 3)
+#define UTF8_SURROGATE  (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS  (1 << 7) // two continuations, legal after 3/4 byte leads
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+#define UTF8_BYTE_1_HIGH \
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, \
+	UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, \
+	UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, \
+	UTF8_TOO_SHORT | UTF8_OVERLONG_2, \
+	UTF8_TOO_SHORT, \
+	UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE, \
+	UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+
+#define UTF8_BYTE_1_LOW \
+	UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, \
+	UTF8_CARRY | UTF8_OVERLONG_2, \
+	UTF8_CARRY, \
+	UTF8_CARRY, \
+	UTF8_CARRY | UTF8_TOO_LARGE, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, \
+	UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+
+#define UTF8_BYTE_2_HIGH \
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, \
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, \
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | \
+		UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4, \
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | \
+		UTF8_TOO_LARGE, \
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | \
+		UTF8_TOO_LARGE, \
+	UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | \
+		UTF8_TOO_LARGE, \
+	UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+
+// Finds the start of a sequence up to 3 bytes before offset, everything 
+// before offset has been checked, so that the scalar validator can pick up
+// from there with any sequence that ran into offset
+static uint32_t SequenceStart(const char* source, uint32_t start, 
+		uint32_t offset) {
+	uint32_t at = (offset - start > 3) ? offset - 3 : start;
+	while (at < offset && ((uint8_t) source[at] & 0xc0) == 0x80)
+		at++;
+
+	return at;
+}
+
+#define SSSE3 __attribute__((target("ssse3")))
+
+static inline SSSE3 __m128i Nibble128(__m128i v) {
+	return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+}
+
+static inline SSSE3 __m128i UTF8Errors128(__m128i in, __m128i prev_in) {
+	const __m128i byte_1_high = _mm_setr_epi8(UTF8_BYTE_1_HIGH);
+	const __m128i byte_1_low = _mm_setr_epi8(UTF8_BYTE_1_LOW);
+	const __m128i byte_2_high = _mm_setr_epi8(UTF8_BYTE_2_HIGH);
+
+	__m128i prev1 = _mm_alignr_epi8(in, prev_in, 15);
+	__m128i special = _mm_and_si128(
+		_mm_and_si128(_mm_shuffle_epi8(byte_1_high, Nibble128(prev1)),
+			_mm_shuffle_epi8(byte_1_low, 
+				_mm_and_si128(prev1, _mm_set1_epi8(0x0f)))),
+		_mm_shuffle_epi8(byte_2_high, Nibble128(in)));
+
+	// Bytes 2 and 3 after a 3 and 4 byte lead must be continuations
+	__m128i prev2 = _mm_alignr_epi8(in, prev_in, 14);
+	__m128i prev3 = _mm_alignr_epi8(in, prev_in, 13);
+	__m128i must23 = _mm_or_si128(
+		_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+		_mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+	__m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8(0x80));
+
+	return _mm_xor_si128(must23_80, special);
+}
+
+// Non zero where the last bytes start a sequence that goes on past them
+static inline SSSE3 __m128i Incomplete128(__m128i in) {
+	const __m128i max = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1);
+	return _mm_subs_epu8(in, max);
+}
+
+static SSSE3 uint32_t SSSE3UTF8(const char* source, uint32_t offset, 
+		uint32_t size) {
+	uint32_t start = offset;
+	__m128i prev = _mm_setzero_si128();
+	__m128i incomplete = _mm_setzero_si128();
+
+	while (offset + 16 <= size) {
+		__m128i in = _mm_loadu_si128((const __m128i*) (source + offset));
+		__m128i error = incomplete;
+		if (_mm_movemask_epi8(in)) {
+			error = UTF8Errors128(in, prev);
+			incomplete = Incomplete128(in);
+		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) 
+				!= 0xffff)
+			break;
+
+		prev = in;
+		offset += 16;
+	}
+
+	return ScalarUTF8(source, SequenceStart(source, start, offset), size);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i AlnumMask256(__m256i v) {
+	__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i digit = _mm256_and_si256(
+			_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+	__m256i alpha = _mm256_and_si256(
+			_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+	return _mm256_or_si256(digit, alpha);
+}
+
+static inline AVX2 __m256i SpaceMask256(__m256i v) {
+	__m256i ctrl = _mm256_and_si256(
+			_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+	return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), ctrl);
+}
+
+static inline AVX2 __m256i LineMask256(__m256i v) {
+	return _mm256_xor_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), 
+			_mm256_set1_epi8(-1));
+}
+
+#define DEFINE_AVX2_SCANNER(name, mask, sse2)                             \
+static AVX2 uint32_t name(const char* source, uint32_t offset,             \
+		uint32_t size) {                                                   \
+	while (offset + 32 <= size) {                                          \
+		__m256i v = _mm256_loadu_si256((const __m256i*) (source + offset));\
+		uint32_t stop = ~(uint32_t) _mm256_movemask_epi8(mask(v));         \
+		if (stop)                                                          \
+			return offset + __builtin_ctz(stop);                           \
+		offset += 32;                                                      \
+	}                                                                      \
+	return sse2(source, offset, size);                                     \
+}
+
+DEFINE_AVX2_SCANNER(AVX2Alnum, AlnumMask256, SSE2Alnum)
+DEFINE_AVX2_SCANNER(AVX2Space, SpaceMask256, SSE2Space)
+DEFINE_AVX2_SCANNER(AVX2Line, LineMask256, SSE2Line)
+
+static inline AVX2 __m256i Nibble256(__m256i v) {
+	return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+// The bytes of in, shifted up by n bytes with the top of prev_in coming in
+#define PREV256(in, prev_in, n) _mm256_alignr_epi8(in, \
+		_mm256_permute2x128_si256(prev_in, in, 0x21), 16 - (n))
+
+static inline AVX2 __m256i UTF8Errors256(__m256i in, __m256i prev_in) {
+	const __m256i byte_1_high = _mm256_setr_epi8(UTF8_BYTE_1_HIGH, 
+			UTF8_BYTE_1_HIGH);
+	const __m256i byte_1_low = _mm256_setr_epi8(UTF8_BYTE_1_LOW, 
+			UTF8_BYTE_1_LOW);
+	const __m256i byte_2_high = _mm256_setr_epi8(UTF8_BYTE_2_HIGH,
+			UTF8_BYTE_2_HIGH);
+
+	__m256i prev1 = PREV256(in, prev_in, 1);
+	__m256i special = _mm256_and_si256(
+		_mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, Nibble256(prev1)),
+			_mm256_shuffle_epi8(byte_1_low, 
+				_mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+		_mm256_shuffle_epi8(byte_2_high, Nibble256(in)));
+
+	__m256i must23 = _mm256_or_si256(
+		_mm256_subs_epu8(PREV256(in, prev_in, 2), 
+			_mm256_set1_epi8(0xe0 - 0x80)),
+		_mm256_subs_epu8(PREV256(in, prev_in, 3), 
+			_mm256_set1_epi8(0xf0 - 0x80)));
+	__m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(0x80));
+
+	return _mm256_xor_si256(must23_80, special);
+}
+
+static inline AVX2 __m256i Incomplete256(__m256i in) {
+	const __m256i max = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1);
+	return _mm256_subs_epu8(in, max);
+}
+
+static AVX2 uint32_t AVX2UTF8(const char* source, uint32_t offset, 
+		uint32_t size) {
+	uint32_t start = offset;
+	__m256i prev = _mm256_setzero_si256();
+	__m256i incomplete = _mm256_setzero_si256();
+
+	while (offset + 32 <= size) {
+		__m256i in = _mm256_loadu_si256((const __m256i*) (source + offset));
+		__m256i error = incomplete;
+		if (_mm256_movemask_epi8(in)) {
+			error = UTF8Errors256(in, prev);
+			incomplete = Incomplete256(in);
+		}
+
+		if (!_mm256_testz_si256(error, error))
+			break;
+
+		prev = in;
+		offset += 32;
+	}
+
+	return ScalarUTF8(source, SequenceStart(source, start, offset), size);
+}
+
+#endif
+
+Scanner scan_alnum = ScalarAlnum;
+Scanner scan_space = ScalarSpace;
+Scanner scan_line = ScalarLine;
+Scanner scan_utf8 = ScalarUTF8;
+
+void InitScanner() {
+#ifdef SCAN_X86
+	// SSE2 is part of the x86-64 baseline
+	scan_alnum = SSE2Alnum;
+	scan_space = SSE2Space;
+	scan_line = SSE2Line;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		scan_utf8 = SSSE3UTF8;
+
+	if (__builtin_cpu_supports("avx2")) {
+		scan_alnum = AVX2Alnum;
+		scan_space = AVX2Space;
+		scan_line = AVX2Line;
+		scan_utf8 = AVX2UTF8;
+	}
+#endif
+}
@@ -1,15 +1,38 @@
 #include "sema.h"
 #include "parser-utils.h"
+#include "expr-pool.h"
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 typedef struct Error {
 	Location* loc;
 	char message[400];
 } Error;
 
+// An error in the top level statement stat
+typedef struct Report {
+	uint32_t stat;
+	Error err;
+} Report;
+
+DEFINE_VECTOR(Reports, Report, 4)
+
+/* What checks statements on one thread: the table they are declared in, 
+ * the arena the symbols and casts are allocated from, and the errors found,
+ * which are kept in reports until the ones of the statements before them 
+ * have been printed. They are printed right away when reports is NULL */
+typedef struct Checker {
+	Lexer* lexer;
+	SymbolTable* symtab;
+	Arena* arena;
+	Reports* reports;
+	uint32_t stat; // the top level statement being checked
+} Checker;
+
 
 static void MakeError(Error* err, Location* loc, const char* msg, ...) {
 	va_list ap;
@@ -21,275 +44,376 @@ static void MakeError(Error* err, Location* loc, const char* msg, ...) {
 }
 
 static void SemaError(Lexer* lexer, Error* err) {
-	printf("%s:%u:%u\nError: %s\n", lexer->file, err->loc->line, 
-			err->loc->pos, err->message);
+	LineInfo li = LexerLocate(lexer, err->loc->offset);
+	printf("%s:%u:%u\nError: %s\n", lexer->file, li.line, li.pos, 
+			err->message);
+
+	if (!li.text)
+		return; // we no longer have the source of this line
 
-	LineExtent* le = Get(lexer->extent, err->loc->line - 1);
-	char* source = lexer->source + le->offset;
-	char* line = malloc(sizeof(char) * (le->length + 1));
-	memcpy(line, source, le->length);
-	line[le->length] = '\0';
+	const char* source = li.text;
+	char* line = malloc(sizeof(char) * (li.length + 1));
+	memcpy(line, source, li.length);
+	line[li.length] = '\0';
 
 	printf("%s\n", line);
-	for (uint32_t i = 0; i < err->loc->pos - 1; i++) { printf(" "); }
+	for (uint32_t i = 0; i < li.pos - 1; i++) { printf(" "); }
 	printf("^\n");
 	free(line);
 }
 
-Symbol* MakeSymbol(const char* name, enum SymbolType type, uint32_t flags) {
-	Symbol* ret = malloc(sizeof(Symbol));
-	if (!ret)
+// A cast of operand to target put between it and the node using it
+static Expr* InsertCast(Expr* operand, Type* target, Arena* arena) {
+	Expr* cast = makeExpr(arena, ET_CAST);
+	if (!cast)
 		return NULL;
 
-	ret->name = name;
-	ret->type = type;
-	ret->flags = flags;
-
-	return ret;
-}
-
-Type* GetType(Vector* symtab, const char* name) {
-	for (uint32_t idx = 0; idx < VectorLength(symtab); idx++) {
-		Symbol* sym = Get(symtab, idx);
-		if (sym->type != TYPE_TYPEDEF)
-			continue;
-
-		if (strcmp(name, sym->name) == 0)
-			return sym->utype;
-	}
-
-	return NULL;
-}
-
-Symbol* GetVariable(Vector* symtab, const char* name) {
-	for (uint32_t idx = 0; idx < VectorLength(symtab); idx++) {
-		Symbol* sym = Get(symtab, idx);
-		if (sym->type != TYPE_VARIABLE)
-			continue;
-
-		if (strcmp(name, sym->name) == 0)
-			return sym;
-	}
-
-	return NULL;
-}
-
-static Type* ConvertTagToType(const int* tag, Vector* symtab) {
-	Type* ret = NULL;
-
-	for (uint32_t idx = 0; idx < VectorLength(symtab); idx++) {
-		Symbol* sym = Get(symtab, idx);
-		if (sym->type == TYPE_TYPEDEF) {
-			if (sym->utype->tag == *tag) {
-				ret = sym->utype;
-				break;
-			}
-		}
-	}
-
-	return ret;
-}
+	cast->cast = Allocate(arena, sizeof(Cast));
+	if (!cast->cast)
+		return NULL;
 
-static const int* ConvertTypeToTag(const Type* type) {
-	return &type->tag;
+	cast->cast->target = target;
+	cast->cast->expr = operand;
+	cast->loc = operand->loc;
+	cast->rtype = target;
+	return cast;
 }
 
-static int SemaExprEvaluate(Vector* opstack, Expr* expr, 
-		Vector* symtab, Error* err) {
+/* Resolves the type of one node, whose operands have theirs already. An 
+ * operand without a type had an error, which has been reported in err, so
+ * the node is left without one too, and no error is made for it. That way
+ * err ends up with the last error in the expression, as when it was checked
+ * by recursion. Returns 0 when out of memory */
+static int SemaExprNode(Expr* expr, SymbolTable* symtab, Arena* arena, 
+		Error* err) {
 	switch (expr->type) {
 		case ET_INT_LITERAL: {
-			Append(opstack, ConvertTypeToTag(expr->literal->type));
+			expr->rtype = expr->literal->type;
 			return 1;
 		}
 
 		case ET_IDENT: {
-			Symbol* sym = GetVariable(symtab, expr->ident);
+			Symbol* sym = Lookup(symtab, expr->ident, TYPE_VARIABLE);
+			expr->sym = NULL;
 			if (!sym) {
 				MakeError(err, &expr->loc, "Undefined identifier %s "
 					"(NOTE: you cannot use a variable in its own initializer)",
-						expr->ident);
-				return 0;
+						NameText(expr->ident));
 			}
 
-			if (!sym->utype) {
+			else if (!sym->utype) {
 				MakeError(err, &expr->loc, 
-					"Variable %s, has not been assigned a type", expr->ident);
-				return 0;
-
+					"Variable %s, has not been assigned a type", 
+					NameText(expr->ident));
 			}
 
-			const int* type = ConvertTypeToTag(sym->utype);
-			Append(opstack, type);
+			else
+				expr->sym = sym;
+
 			return 1;
 		}
 
 		case ET_UNARY_OP: {
-			int l = SemaExprEvaluate(opstack, expr->unop->operand, symtab, err);
-			if (!l) 
-				return 0;
+			Type* lhs = TypeOfExpr(expr->unop->operand);
+			expr->rtype = NULL;
+			if (!lhs)
+				return 1;
 
-			int* lhs = Pop(opstack);
-			if (!TypeSupportsOp(ConvertTagToType(lhs, symtab), 
-						expr->unop->type)) {
+			if (!TypeSupportsOp(lhs, expr->unop->type))
 				MakeError(err, &expr->loc, "Invalid type for unary operator");
-				return 0;
-
-			}
-
-			if (lhs == INVALID_INDEX) {
-				printf("SemaExprEvaluate(): lhs == NULL\n");
-				return 0;
-			}
+			else
+				expr->rtype = lhs;
 
-			Append(opstack, lhs);
 			return 1;
 		}
 
 		case ET_CAST: {
-			int l = SemaExprEvaluate(opstack, expr->cast->expr, symtab, err);
-			if (!l)
-				return 0;
-
-			int *lhs = Pop(opstack);
-			if (lhs == INVALID_INDEX) {
-				printf("SemaExprEvaluate(): lhs == NULL\n");
-				return 0;
-			}
-
-			Append(opstack, ConvertTypeToTag(expr->cast->target));
+			expr->rtype = (TypeOfExpr(expr->cast->expr)) 
+				? expr->cast->target : NULL;
 			return 1;
 		}
 
 		case ET_BINARY_OP: {
-			int l = SemaExprEvaluate(opstack, expr->binop->left, symtab, err);
-			int r = SemaExprEvaluate(opstack, expr->binop->right, symtab, err);
-			if (!l || !r)
-				return 0;
-
-			int* rhs = Pop(opstack);
-			int* lhs = Pop(opstack);
-			if (lhs == INVALID_INDEX || rhs == INVALID_INDEX) {
-				printf("SemaExprEvaluate(): lhs == NULL || rhs == NULL\n");
-				return 0;
-			}
-
-			Type* tlhs = ConvertTagToType(lhs, symtab);
-			Type* trhs = ConvertTagToType(rhs, symtab);
+			Type* tlhs = TypeOfExpr(expr->binop->left);
+			Type* trhs = TypeOfExpr(expr->binop->right);
+			expr->rtype = NULL;
+			if (!tlhs || !trhs)
+				return 1;
 
 			if (!TypeSupportsOp(tlhs, expr->binop->type)) {
 				MakeError(err, &expr->binop->left->loc, "Incompatible operand for operator of type %s", tlhs->name);
-				return 0;
+				return 1;
 			}
 
 			if (!TypeSupportsOp(trhs, expr->binop->type)) {
 				MakeError(err, &expr->binop->right->loc, "Incompatible operand for operator of type %s", trhs->name);
-				return 0;
+				return 1;
 
 			}
 
-			if (*lhs != *rhs) {
+			Type* result = tlhs;
+			if (tlhs->tag != trhs->tag) {
 				int l2r = (expr->binop->type == OP_BINARY_EQUALS) 
 					? 0 : TypesCompatible(tlhs, trhs);
 				int r2l = TypesCompatible(trhs, tlhs);
-				Expr* target = NULL;
 
 				if (l2r) {
-					Expr* saved = expr->binop->left;
-					target = makeExpr(ET_CAST);
-					target->cast = malloc(sizeof(Cast));
-					target->cast->target = trhs;
-					target->cast->expr = saved;
-					target->loc = saved->loc;
-					expr->binop->left = target;
-					lhs = rhs;
+					Expr* cast = InsertCast(expr->binop->left, trhs, arena);
+					if (!cast)
+						return 0;
+
+					expr->binop->left = cast;
+					result = trhs;
 				}
 
 				else if (r2l) {
-					Expr* saved = expr->binop->right;
-					target = makeExpr(ET_CAST);
-					target->cast = malloc(sizeof(Cast));
-					target->cast->target = tlhs;
-					target->cast->expr = saved;
-					target->loc = saved->loc;
-					expr->binop->right = target;
+					Expr* cast = InsertCast(expr->binop->right, tlhs, arena);
+					if (!cast)
+						return 0;
+
+					expr->binop->right = cast;
 				}
 
 				else {
 					MakeError(err, &expr->loc, "Mismatching types for operator (%s and %s)", tlhs->name, trhs->name);
-					return 0;
+					return 1;
 				}
 			}
 
-			Append(opstack, lhs);
+			expr->rtype = result;
 			return 1;
 		}
 
 		default: {
-			printf("Sema has not been implemented for expr->type = %d\n",
-					expr->type);
-			return 0;
+			MakeError(err, &expr->loc, "Sema has not been implemented for "
+				"expr->type = %d", expr->type);
+			expr->rtype = NULL;
+			return 1;
 		}
 	}
 }
 
-static Type* SemaExpression(Expr* expr, Vector* symtab, Error* err) {
-	Vector* opstack = NewVector();
-	if (!SemaExprEvaluate(opstack, expr, symtab, err))
-		return NULL;
-	
-	if (VectorLength(opstack) != 1) {
-		printf("SemaExpression(): len(opstack) != 1\n");
-		return NULL;
+/* Interns a node that has been resolved without errors, along with the 
+ * casts put under it, now that every name in it stands for one variable.
+ * It is then EXPR_TYPED like the nodes the parser shared */
+static Expr* ShareResolved(ExprPool* pool, Expr* expr) {
+	Type* type = TypeOfExpr(expr);
+	if (!pool || !type || (expr->flags & EXPR_SHARED))
+		return expr;
+
+	expr = InternExpr(pool, expr);
+	if (!(expr->flags & EXPR_SHARED))
+		return expr;
+
+	// The parser shares a node without names before it is resolved
+	if (expr->type != ET_IDENT && !expr->rtype)
+		expr->rtype = type;
+
+	expr->flags |= EXPR_TYPED;
+	return expr;
+}
+
+static void ShareOperands(ExprPool* pool, Expr* expr) {
+	switch (expr->type) {
+		case ET_UNARY_OP: 
+			expr->unop->operand = ShareResolved(pool, expr->unop->operand);
+			break;
+		case ET_CAST:
+			expr->cast->expr = ShareResolved(pool, expr->cast->expr);
+			break;
+		case ET_BINARY_OP: {
+			expr->binop->left = ShareResolved(pool, expr->binop->left);
+			expr->binop->right = ShareResolved(pool, expr->binop->right);
+			break;
+		}
+		default: break;
+	}
+}
+
+/* Where the error of a shared node that has just come out of walk goes, 
+ * when it is not the first expression in the file the node appears in. It
+ * has the location of that first one wherever it is used, so the error 
+ * goes to the innermost node above it that is not shared, or to site, the
+ * statement, when the whole expression is */
+static Location* UseSite(ExprWalk* walk, Location* site) {
+	for (uint32_t i = walk->stack.size; i > 0; i--) {
+		ExprVisit* visit = ExprVisitStackAt(&walk->stack, i - 1);
+		if (visit->expanded && !(visit->expr->flags & EXPR_SHARED))
+			return &visit->expr->loc;
 	}
 
-	return ConvertTagToType(Pop(opstack), symtab);
+	return site;
 }
 
+/* Resolves the type of every node in one post-order walk, which keeps them
+ * in the nodes, see Expr.rtype and Expr.sym, so that nothing is allocated 
+ * unless the expression is nested deeper than the walk keeps inline.
+ *
+ * A node shared through an ExprPool is the same wherever it appears, so it
+ * is only resolved the first time it is reached, after which it is marked
+ * EXPR_TYPED and its operands are skipped. Casts are only put under it that
+ * first time too. Nodes with errors are checked again every time, so that 
+ * every occurrence is reported, at the use site, see UseSite(). With a 
+ * pool, the operands of a node are shared once it has been resolved, and so
+ * is the root, see ShareResolved()
+ */
+static Type* SemaExpression(Checker* checker, Expr** root, Location* site,
+		Error* err) {
+	ExprPool* pool = checker->lexer->pool;
+	Expr* expr = *root;
+	int ok = 1;
+	ExprWalk walk;
+
+	BeginExprWalk(&walk, expr);
+	walk.leaves = EXPR_TYPED;
+	while (ok && (expr = NextExpr(&walk))) {
+		if (expr->flags & EXPR_TYPED)
+			continue;
+
+		ok = SemaExprNode(expr, checker->symtab, checker->arena, err);
+		if (!TypeOfExpr(expr)) {
+			// Its operands are shared too, their errors have the same site
+			if ((expr->flags & EXPR_SHARED) && err->loc->offset < site->offset)
+				err->loc = UseSite(&walk, site);
 
-static int SemaVarDecl(Statement* stat, Vector* symtab, Error* err) {
+			continue;
+		}
+
+		if (pool)
+			ShareOperands(pool, expr);
+
+		if (expr->flags & EXPR_SHARED)
+			expr->flags |= EXPR_TYPED;
+	}
+
+	ok = ok && !walk.failed;
+	if (!ok)
+		MakeError(err, &(*root)->loc, "Out of memory");
+
+	EndExprWalk(&walk);
+	if (!ok)
+		return NULL;
+
+	*root = ShareResolved(pool, *root);
+	return TypeOfExpr(*root);
+}
+
+/* The initializer is an assignment to the variable, so the variable is in
+ * scope, with the type it was given if any, before the initializer is 
+ * checked. It shadows any variable of the same name from then on */
+static int SemaVarDecl(Checker* checker, Statement* stat, Error* err) {
+	SymbolTable* symtab = checker->symtab;
 	VarDecl* vardecl = stat->vardecl;
 	Type* ty = NULL;
 
 	if (vardecl->type) {
-		ty = GetType(symtab, vardecl->type);
-		if (!ty) {
-			MakeError(err, &vardecl->loc_type, "Unknown type name %s", vardecl->type);
+		Symbol* type = Lookup(symtab, vardecl->type, TYPE_TYPEDEF);
+		if (!type) {
+			MakeError(err, &vardecl->loc_type, "Unknown type name %s", 
+					NameText(vardecl->type));
 			return 0;
 		}
+
+		ty = type->utype;
+	}
+
+	Symbol* sym = Declare(symtab, vardecl->ident, TYPE_VARIABLE, 0);
+	if (!sym) {
+		MakeError(err, &vardecl->loc, "Out of memory");
+		return 0;
 	}
 
-	Symbol* sym = MakeSymbol(vardecl->ident, TYPE_VARIABLE, 0);
-	Append(symtab, sym);
-	sym->utype = (ty) ? ty : NULL;
+	sym->utype = ty;
+	vardecl->sym = sym;
 
 	if (vardecl->init) {
-		Type* type = SemaExpression(vardecl->init, symtab, err);
+		Type* type = SemaExpression(checker, &vardecl->init, &stat->loc, 
+				err);
 		if (!type)
 			return 0;
 
-		if (ty) {
-			if (ty != type) {
-				MakeError(err, &vardecl->loc, "Mismatch between types of "
-					"variable %s and initializer expression", vardecl->ident);
-				return 0;
-			}
-			else
-				sym->utype = type;
+		if (ty && ty != type) {
+			MakeError(err, &vardecl->loc, "Mismatch between types of "
+				"variable %s and initializer expression", 
+					NameText(vardecl->ident));
+			return 0;
 		}
-		else
-			sym->utype = type;
+
+		sym->utype = type;
 	}
 
-	Append(symtab, sym);
 	return 1;
 }
 
-static int SemaStatement(Statement* stat, Vector* symtab, Error* err) {
+static void ReportError(Checker* checker, Error* err) {
+	Report* report = (checker->reports) ? PushReports(checker->reports) 
+		: NULL;
+	if (!report) {
+		SemaError(checker->lexer, err);
+		return;
+	}
+
+	report->stat = checker->stat;
+	report->err = *err;
+}
+
+static int SemaStatements(Checker* checker, Vector* statements);
+
+// The parameters and the body of a function are in a scope of their own
+static int SemaFunction(Checker* checker, Statement* stat, Error* err) {
+	Function* func = stat->func;
+	SymbolTable* symtab = checker->symtab;
+	if (func->rtype && !Lookup(symtab, func->rtype, TYPE_TYPEDEF)) {
+		MakeError(err, &stat->loc, "Unknown return type %s of function %s",
+				NameText(func->rtype), NameText(func->name));
+		return 0;
+	}
+
+	// FunctionBody() reports its own errors
+	Vector* body = FunctionBody(checker->lexer, func);
+	if (!body)
+		return -1;
+
+	if (!PushScope(symtab)) {
+		MakeError(err, &stat->loc, "Out of memory");
+		return 0;
+	}
+
+	int ok = 1;
+	for (uint32_t i = 0; ok && i < VectorLength(func->args); i++) {
+		FuncArgs* arg = Get(func->args, i);
+		Symbol* type = Lookup(symtab, arg->type, TYPE_TYPEDEF);
+		Symbol* sym = NULL;
+		if (!type)
+			MakeError(err, &stat->loc, "Unknown type %s of parameter %s",
+					NameText(arg->type), NameText(arg->name));
+		else if (!(sym = Declare(symtab, arg->name, TYPE_VARIABLE, 0)))
+			MakeError(err, &stat->loc, "Out of memory");
+		else
+			sym->utype = type->utype;
+
+		ok = sym != NULL;
+	}
+
+	if (ok && !SemaStatements(checker, body))
+		ok = -1;
+
+	PopScope(symtab);
+	return ok;
+}
+
+// Returns 0 with err filled in, or -1 when the error has been reported
+static int SemaStatement(Checker* checker, Statement* stat, Error* err) {
 	switch (stat->type) {
-		case ST_VARDECL: return SemaVarDecl(stat, symtab, err);
-		case ST_EXPR: return SemaExpression(stat->expr, symtab, err) != NULL;
+		case ST_VARDECL: 
+			return SemaVarDecl(checker, stat, err);
+		case ST_EXPR: 
+			return SemaExpression(checker, &stat->expr, &stat->loc, err) 
+				!= NULL;
+		case ST_FUNCTION: return SemaFunction(checker, stat, err);
 		default: {
-			printf("SemaStatement(): Unknown statement type\n");
+			MakeError(err, &stat->loc, "SemaStatement(): Unknown statement "
+				"type");
 			break;
 		}
 	}
@@ -297,26 +421,340 @@ static int SemaStatement(Statement* stat, Vector* symtab, Error* err) {
 	return 0;
 }
 
+// Reports the error of every statement that has one, returns 0 if any did
+static int SemaStatements(Checker* checker, Vector* statements) {
+	int error = 0;
+	for (uint32_t i = 0; i < VectorLength(statements); i++) {
+		Error err;
+		int ok = SemaStatement(checker, Get(statements, i), &err);
+		if (!ok)
+			ReportError(checker, &err);
+
+		error |= ok != 1;
+	}
+
+	return !error;
+}
+
+/* Function bodies are checked once everything at the top level has been,
+ * when the table of the globals no longer changes, so they can be checked
+ * on several threads, each with an inner table of its own, see 
+ * NewInnerTable(). A body sees the globals declared before the function, 
+ * as SymbolTable.visible is set to how many there were for each.
+ *
+ * The bodies skipped by LEXER_LAZY are parsed first, on one thread, with
+ * LEXER_QUIET. A function whose body fails to parse is left to be checked 
+ * on one thread when its errors are printed, so that FunctionBody() prints
+ * the parse error where it belongs. The others are cut into contiguous
+ * chunks with about the same number of tokens. Nodes shared through an 
+ * ExprPool are written to when they are first checked, so with a pool all
+ * of them are checked on one thread.
+ *
+ * The errors of every thread are in the order of their statements, and are
+ * merged into source order once all of them are done */
+
+#define SEMA_CHUNK_MIN (32 * 1024) // fewer tokens are not worth a thread
+#define SEMA_THREADS_MAX 64
+#define NO_CHUNK UINT32_MAX
+
+typedef struct SemaJob {
+	uint32_t stat;    // index of the function in the statements
+	uint32_t visible; // how many global symbols were declared before it
+	uint32_t chunk;   // NO_CHUNK when its body did not parse
+} SemaJob;
+
+DEFINE_VECTOR(SemaJobs, SemaJob, 16)
+
+typedef struct SemaChunk {
+	Checker  checker;
+	Reports  reports;
+	Arena    arena;
+	Vector*  stats;
+	SemaJob* jobs;  // the jobs [first, end) that have this chunk
+	uint32_t first;
+	uint32_t end;
+	int      failed;
+	pthread_t thread;
+} SemaChunk;
+
+// Parses the bodies LEXER_LAZY skipped in func, including its own, returns
+// 0 if one of them does not parse
+static int ParseBodies(Lexer* lexer, Function* func) {
+	Vector* body = FunctionBody(lexer, func);
+	for (uint32_t i = 0; body && i < VectorLength(body); i++) {
+		Statement* stat = Get(body, i);
+		if (stat->type == ST_FUNCTION && !ParseBodies(lexer, stat->func))
+			return 0;
+	}
+
+	return body != NULL;
+}
+
+static uint32_t BodyTokens(Statement* stat) {
+	Function* func = stat->func;
+	return (func->body_end > func->body) ? func->body_end - func->body : 1;
+}
+
+static void* CheckChunk(void* arg) {
+	SemaChunk* chunk = arg;
+	Checker* checker = &chunk->checker;
+
+	for (uint32_t i = chunk->first; i < chunk->end; i++) {
+		SemaJob* job = &chunk->jobs[i];
+		if (job->chunk == NO_CHUNK)
+			continue;
+
+		Error err;
+		checker->stat = job->stat;
+		checker->symtab->visible = job->visible;
+		int ok = SemaFunction(checker, Get(chunk->stats, job->stat), &err);
+		if (!ok)
+			ReportError(checker, &err);
+
+		chunk->failed |= ok != 1;
+	}
+
+	return NULL;
+}
+
+static uint32_t Threads(uint32_t threads, uint64_t ntokens) {
+	if (!threads) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 0 ? cores : 1;
+	}
+
+	if (threads > ntokens / SEMA_CHUNK_MIN)
+		threads = ntokens / SEMA_CHUNK_MIN;
+
+	if (!threads)
+		return 1;
+
+	return threads > SEMA_THREADS_MAX ? SEMA_THREADS_MAX : threads;
+}
+
+/* Gives the jobs that parsed to at most nchunks chunks of about the same 
+ * number of tokens. Returns the number of chunks */
+static uint32_t CutJobs(SemaJobs* jobs, Vector* stats, uint64_t ntokens,
+		uint32_t nchunks, SemaChunk* chunks) {
+	uint32_t chunk = 0;
+	uint64_t tokens = 0;
+
+	for (uint32_t i = 0; i < jobs->size; i++) {
+		SemaJob* job = SemaJobsAt(jobs, i);
+		if (job->chunk == NO_CHUNK)
+			continue;
+
+		if (tokens >= ntokens * (chunk + 1) / nchunks && 
+				chunk + 1 < nchunks) {
+			chunks[chunk++].end = i;
+			chunks[chunk].first = i;
+		}
+
+		job->chunk = chunk;
+		tokens += BodyTokens(Get(stats, job->stat));
+	}
+
+	chunks[chunk].end = jobs->size;
+	return chunk + 1;
+}
+
+static int InitChunk(SemaChunk* chunk, Lexer* lexer, SymbolTable* globals,
+		Arena* arena) {
+	Arena* own = NULL;
+	if (arena) {
+		InitArena(&chunk->arena, arena->flags);
+		own = &chunk->arena;
+	}
+
+	InitReports(&chunk->reports);
+	chunk->checker.lexer = lexer;
+	chunk->checker.arena = own;
+	chunk->checker.reports = &chunk->reports;
+	chunk->checker.symtab = NewInnerTable(globals, 0, own);
+	return chunk->checker.symtab != NULL;
+}
+
+// Prints the errors of stat at the front of reports, from *next on
+static void PrintReports(Lexer* lexer, Reports* reports, uint32_t* next, 
+		uint32_t stat) {
+	for (; *next < reports->size; (*next)++) {
+		Report* report = ReportsAt(reports, *next);
+		if (report->stat != stat)
+			break;
+
+		SemaError(lexer, &report->err);
+	}
+}
+
+// Checks the bodies of the functions, and prints the errors of everything 
+// in the order of the statements. Returns 0 if there was any
+static int CheckBodies(Checker* top, Vector* stats, SemaJobs* jobs, 
+		uint32_t threads) {
+	Lexer* lexer = top->lexer;
+	SymbolTable* globals = top->symtab;
+	Arena* arena = top->arena;
+	int error = 0;
+
+	uint64_t ntokens = 0;
+	for (uint32_t i = 0; i < jobs->size; i++) {
+		SemaJob* job = SemaJobsAt(jobs, i);
+		if (job->chunk != NO_CHUNK)
+			ntokens += BodyTokens(Get(stats, job->stat));
+	}
+
+	threads = (lexer->pool) ? 1 : Threads(threads, ntokens);
+	SemaChunk* chunks = calloc(threads, sizeof(SemaChunk));
+	if (!chunks) {
+		printf("Out of memory\n");
+		return 0;
+	}
+
+	uint32_t nchunks = CutJobs(jobs, stats, ntokens, threads, chunks);
+	int ok = 1;
+	for (uint32_t i = 0; i < nchunks; i++) {
+		chunks[i].stats = stats;
+		chunks[i].jobs = jobs->data;
+		ok = InitChunk(&chunks[i], lexer, globals, arena) && ok;
+	}
+
+	uint32_t spawned = 1;
+	for (; ok && spawned < nchunks; spawned++) {
+		SemaChunk* chunk = &chunks[spawned];
+		if (pthread_create(&chunk->thread, NULL, CheckChunk, chunk))
+			break;
+	}
+
+	if (ok) {
+		CheckChunk(&chunks[0]);
+		for (uint32_t i = spawned; i < nchunks; i++)
+			CheckChunk(&chunks[i]);
+	}
+
+	for (uint32_t i = 1; ok && i < spawned; i++)
+		pthread_join(chunks[i].thread, NULL);
+
+	// The functions whose bodies did not parse are checked as their errors
+	// are due, and print them right away
+	Checker late = { lexer, NULL, arena, NULL, 0 };
+	uint32_t next = 0, job = 0;
+	uint32_t* nexts = calloc(nchunks, sizeof(uint32_t));
+	if (ok && nexts)
+		late.symtab = NewInnerTable(globals, 0, arena);
+
+	if (!late.symtab) {
+		printf("Out of memory\n");
+		error = 1;
+	}
+
+	for (uint32_t i = 0; late.symtab && i < VectorLength(stats); i++) {
+		PrintReports(lexer, top->reports, &next, i);
+		if (job == jobs->size || SemaJobsAt(jobs, job)->stat != i)
+			continue;
+
+		SemaJob* pending = SemaJobsAt(jobs, job++);
+		if (pending->chunk != NO_CHUNK) {
+			PrintReports(lexer, &chunks[pending->chunk].reports, 
+					&nexts[pending->chunk], i);
+			continue;
+		}
+
+		Error err;
+		late.stat = i;
+		late.symtab->visible = pending->visible;
+		int checked = SemaFunction(&late, Get(stats, i), &err);
+		if (!checked)
+			SemaError(lexer, &err);
+
+		error |= checked != 1;
+	}
+
+	for (uint32_t i = 0; i < nchunks; i++) {
+		SemaChunk* chunk = &chunks[i];
+		SymbolTable* symtab = chunk->checker.symtab;
+		error |= chunk->failed;
+		if (symtab && !AdoptSymbols(globals, symtab)) {
+			printf("Out of memory\n");
+			error = 1;
+		}
+
+		DeleteSymbolTable(symtab);
+		DeleteReports(&chunk->reports);
+		if (arena)
+			ArenaAdopt(arena, &chunk->arena);
+	}
 
-Vector* SemanticAnalyse(Lexer* lexer, Vector* statements) {
+	if (late.symtab && !AdoptSymbols(globals, late.symtab)) {
+		printf("Out of memory\n");
+		error = 1;
+	}
+
+	DeleteSymbolTable(late.symtab);
+	free(nexts);
+	free(chunks);
+	return !error;
+}
+
+SymbolTable* SemanticAnalyse(Lexer* lexer, Vector* statements, 
+		Arena* arena, uint32_t threads) {
 	if (!VectorLength(statements))
 		return NULL;
 
-	Vector* symtab = NewVector();
+	SymbolTable* symtab = NewSymbolTable(arena);
+	if (!symtab) {
+		printf("Out of memory\n");
+		return NULL;
+	}
+
 	for (int i = 0; i < len_builtins; i++) {
-		Symbol* sym = MakeSymbol(BUILTIN_TYPES[i]->name, TYPE_TYPEDEF, 0);
+		Name name = InternString(BUILTIN_TYPES[i]->name);
+		Symbol* sym = (name) ? Declare(symtab, name, TYPE_TYPEDEF, 0) : NULL;
+		if (!sym) {
+			printf("Out of memory\n");
+			DeleteSymbolTable(symtab);
+			return NULL;
+		}
+
 		sym->utype = BUILTIN_TYPES[i];
-		Append(symtab, sym);
 	}
 
-	int error = 0;
-	for (uint32_t i = 0; i < VectorLength(statements); i++) {
+	Reports reports;
+	SemaJobs jobs;
+	Checker top = { lexer, symtab, arena, &reports, 0 };
+	uint32_t quiet = lexer->flags & LEXER_QUIET;
+	int ok = 1, error = 0;
+
+	InitReports(&reports);
+	InitSemaJobs(&jobs);
+	for (uint32_t i = 0; ok && i < VectorLength(statements); i++) {
+		Statement* stat = Get(statements, i);
 		Error err;
-		if (!SemaStatement(Get(statements, i), symtab, &err)) {
-			SemaError(lexer, &err);
+		top.stat = i;
+
+		if (stat->type == ST_FUNCTION) {
+			lexer->flags |= LEXER_QUIET;
+			SemaJob job = { i, VectorLength(symtab->symbols), 
+				ParseBodies(lexer, stat->func) ? 0 : NO_CHUNK };
+			lexer->flags = (lexer->flags & ~LEXER_QUIET) | quiet;
+
+			ok = AppendSemaJobs(&jobs, job);
+			if (!ok)
+				printf("Out of memory\n");
+		}
+
+		else if (!SemaStatement(&top, stat, &err)) {
+			ReportError(&top, &err);
 			error = 1;
 		}
 	}
 
-	return (error) ? NULL : symtab;
+	ok = ok && CheckBodies(&top, statements, &jobs, threads) && !error;
+	DeleteReports(&reports);
+	DeleteSemaJobs(&jobs);
+
+	if (!ok) {
+		DeleteSymbolTable(symtab);
+		return NULL;
+	}
+
+	return symtab;
 }
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+
+// The maps are keyed by the number of a name, which is never 0
+#define NAME_KEY(name) ((void*) (uintptr_t) (name))
+
+SymbolTable* NewSymbolTable(Arena* arena) {
+	SymbolTable* table = calloc(1, sizeof(SymbolTable));
+	if (!table)
+		return NULL;
+
+	table->arena = arena;
+	table->symbols = NewVector();
+	table->scoped = NewVector();
+	InitScopeMarks(&table->scopes);
+
+	int ok = table->symbols && table->scoped;
+	for (int i = 0; i < SYMBOL_TYPES; i++) {
+		table->names[i] = NewMap(HashPointer, ComparePointers);
+		ok = ok && table->names[i];
+	}
+
+	if (!ok) {
+		DeleteSymbolTable(table);
+		return NULL;
+	}
+
+	return table;
+}
+
+SymbolTable* NewInnerTable(SymbolTable* outer, uint32_t visible, 
+		Arena* arena) {
+	SymbolTable* table = NewSymbolTable(arena);
+	if (!table)
+		return NULL;
+
+	table->outer = outer;
+	table->visible = visible;
+	for (int i = 0; i < SYMBOL_TYPES; i++) {
+		table->found[i] = NewMap(HashPointer, ComparePointers);
+		if (!table->found[i]) {
+			DeleteSymbolTable(table);
+			return NULL;
+		}
+	}
+
+	return table;
+}
+
+void DeleteSymbolTable(SymbolTable* table) {
+	if (!table)
+		return;
+
+	if (!table->arena && table->symbols)
+		for (uint32_t i = 0; i < VectorLength(table->symbols); i++)
+			free(Get(table->symbols, i));
+
+	for (int i = 0; i < SYMBOL_TYPES; i++) {
+		DeleteMap(table->names[i]);
+		DeleteMap(table->found[i]);
+	}
+
+	DeleteVector(table->symbols);
+	DeleteVector(table->scoped);
+	DeleteScopeMarks(&table->scopes);
+	free(table);
+}
+
+int AdoptSymbols(SymbolTable* table, SymbolTable* from) {
+	uint32_t length = VectorLength(table->symbols);
+	for (uint32_t i = 0; i < VectorLength(from->symbols); i++) {
+		if (!Append(table->symbols, Get(from->symbols, i))) {
+			while (VectorLength(table->symbols) > length)
+				Pop(table->symbols);
+
+			return 0;
+		}
+	}
+
+	while (VectorLength(from->symbols))
+		Pop(from->symbols);
+
+	return 1;
+}
+
+int PushScope(SymbolTable* table) {
+	return AppendScopeMarks(&table->scopes, VectorLength(table->scoped));
+}
+
+void PopScope(SymbolTable* table) {
+	uint32_t start = PopScopeMarks(&table->scopes);
+	while (VectorLength(table->scoped) > start) {
+		Symbol* sym = Pop(table->scoped);
+		Map* names = table->names[sym->type];
+
+		// The entry is there, the symbol was the innermost of its name
+		if (sym->shadowed)
+			MapFind(names, NAME_KEY(sym->name))->value = sym->shadowed;
+		else
+			MapRemove(names, NAME_KEY(sym->name));
+	}
+}
+
+Symbol* Declare(SymbolTable* table, Name name, enum SymbolType type,
+		uint32_t flags) {
+	Symbol* sym = Allocate(table->arena, sizeof(Symbol));
+	if (!sym)
+		return NULL;
+
+	memset(sym, 0, sizeof(Symbol));
+	sym->name = name;
+	sym->type = type;
+	sym->flags = flags;
+
+	sym->order = VectorLength(table->symbols);
+	int symbols = Append(table->symbols, sym);
+	int scoped = symbols && table->scopes.size && 
+		Append(table->scoped, sym);
+
+	MapEntry* entry = NULL;
+	if (symbols && (scoped || !table->scopes.size))
+		entry = MapInsertHashed(table->names[type], NAME_KEY(name),
+				HashPointer(NAME_KEY(name)), sym);
+
+	if (!entry) {
+		if (symbols)
+			Pop(table->symbols);
+
+		if (scoped)
+			Pop(table->scoped);
+
+		if (!table->arena)
+			free(sym);
+
+		return NULL;
+	}
+
+	if (entry->value != sym) {
+		sym->shadowed = entry->value;
+		if (!table->scopes.size)
+			sym->shadowed->shadowing = sym;
+
+		entry->value = sym;
+	}
+
+	return sym;
+}
+
+Symbol* Lookup(SymbolTable* table, Name name, enum SymbolType type) {
+	Symbol* sym = MapGet(table->names[type], NAME_KEY(name));
+	if (sym || !table->outer)
+		return sym;
+
+	// The outer table has no open scopes, so every symbol it has of the name
+	// is on the chain, in the order they were declared in
+	MapEntry* found = MapFind(table->found[type], NAME_KEY(name));
+	sym = (found) ? found->value : 
+		MapGet(table->outer->names[type], NAME_KEY(name));
+	if (!sym)
+		return NULL;
+
+	while (sym->order >= table->visible && sym->shadowed)
+		sym = sym->shadowed;
+
+	while (sym->shadowing && sym->shadowing->order < table->visible)
+		sym = sym->shadowing;
+
+	// Out of memory only means the next lookup starts further off
+	if (found)
+		found->value = sym;
+	else
+		MapInsert(table->found[type], NAME_KEY(name), sym);
+
+	return (sym->order < table->visible) ? sym : NULL;
+}
@@ -1,23 +1,63 @@
+#include <stddef.h>
+#include <stdio.h>
 #include "types.h"
 #include "primitives.h"
 
-int TypeSupportsOp(Type* type, OperatorCode code) {
-	if (type->tag >= BUILTIN_TAGS_MAX)
-		return -1;
+_Static_assert(OP_MAX <= 32, "Too many operators for Type.ops");
+
+// The builtin types come first, their tags are their index in BUILTIN_TYPES
+static Type* registry[TYPE_TAGS_MAX];
+static int ntags;
 
-	int arity = OperatorArity(code);
-	if (!PrimitiveSupportsOp(type, code, arity))
+int RegisterType(Type* type) {
+	if (!ntags)
+		ntags = BUILTIN_TAGS_MAX;
+
+	if (ntags == TYPE_TAGS_MAX)
 		return 0;
 
+	type->tag = ntags;
+	registry[ntags++] = type;
 	return 1;
 }
 
-int TypesCompatible(Type* t1, Type* t2) {
-	if (t1->tag >= BUILTIN_TAGS_MAX || t2->tag >= BUILTIN_TAGS_MAX)
-		return -1;
+Type* TypeOfTag(int tag) {
+	if (tag < 0 || tag >= TYPE_TAGS_MAX)
+		return NULL;
+
+	return (tag < BUILTIN_TAGS_MAX) ? BUILTIN_TYPES[tag] : registry[tag];
+}
+
+void AllowConversion(Type* from, Type* to) {
+	from->converts |= TAG_BIT(to->tag);
+}
 
-	if (!PrimitiveTypesCompatible(t1, t2))
+/* Checks that an integer literal with the magnitude value is in the range of
+ * type. A negated literal may be one larger than the maximum of a signed
+ * type, negating an unsigned one is left for sema to report. Registered 
+ * types have no range, so no literal fits them */
+int TypeFitsLiteral(Type* type, uint64_t value, int negated) {
+	if (type->tag >= BUILTIN_TAGS_MAX)
 		return 0;
 
-	return 1;
+	int bits = type->size * 8;
+	if (PrimitiveIsUnsigned(type))
+		return (value >> (bits - 1)) >> 1 == 0;
+
+	uint64_t max = ((uint64_t) 1 << (bits - 1)) - 1;
+	return value <= max + (negated != 0);
+}
+
+// Registered types are never unsigned integers
+int TypeIsUnsigned(Type* type) {
+	return type->tag < BUILTIN_TAGS_MAX && PrimitiveIsUnsigned(type);
+}
+
+/* Literals keep the bits of their value in a uint64_t, which only reads as 
+ * negative for a signed type */
+void PrintLiteral(Type* type, uint64_t value) {
+	if (TypeIsUnsigned(type))
+		printf("%lu", value);
+	else
+		printf("%ld", (int64_t) value);
 }
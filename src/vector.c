@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "vector.h"
 
 Vector* NewVector() {
@@ -11,9 +12,12 @@ Vector* VectorOfLength(uint32_t size) {
 		return NULL;
 
 	vec->size = size;
-	vec->capacity = vec->size + 100;
-	vec->data = malloc(sizeof(void*) * vec->capacity);
+	vec->capacity = size;
+	vec->data = NULL;
+	if (!size)
+		return vec;
 
+	vec->data = malloc(sizeof(void*) * vec->capacity);
 	if (!vec->data) {
 		free(vec);
 		return NULL;
@@ -34,16 +38,21 @@ uint32_t VectorLength(Vector* vec) {
 	return vec->size;
 }
 
-void Append(Vector* vec, const void* data) {
+// Returns 0 when out of memory, and leaves the vector as it was
+int Append(Vector* vec, const void* data) {
 	if (vec->size >= vec->capacity) {
-		vec->capacity += 100;
-		vec->data = realloc(vec->data, vec->capacity * sizeof(void*));
-		if (!vec->data)
-			return;
+		uint32_t capacity = (vec->capacity) ? vec->capacity * 2 : 8;
+		void** grown = realloc(vec->data, capacity * sizeof(void*));
+		if (!grown)
+			return 0;
+
+		vec->data = grown;
+		vec->capacity = capacity;
 	}
 
 	vec->data[vec->size] = (void*) data;
 	vec->size++;
+	return 1;
 }
 
 void* Get(Vector* vec, uint32_t index) {
@@ -61,3 +70,18 @@ void* Pop(Vector* vec) {
 	vec->size--;
 	return data;
 }
+
+int GrowVector(void** data, void* local, size_t size, uint32_t* capacity) {
+	uint32_t count = (*capacity) ? *capacity * 2 : 8;
+	void* grown = (*data == local) ? malloc(count * size) :
+		realloc(*data, count * size);
+	if (!grown)
+		return 0;
+
+	if (*data == local)
+		memcpy(grown, local, *capacity * size);
+
+	*data = grown;
+	*capacity = count;
+	return 1;
+}
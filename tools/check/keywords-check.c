@@ -0,0 +1,53 @@
+/* Built by make check from the tables tools/genkeywords.c makes out of the
+ * keywords.def next to this file. Looks every keyword up the way 
+ * ReadIdentOrKeyword() does, and a few identifiers that are close to them.
+ * Returns 1 if any lookup is wrong */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum TokenType {
+	TT_IDENT,
+#define KEYWORD(spelling, type) type,
+#include "keywords.def"
+#undef KEYWORD
+} TokenType;
+
+#include "keywords.inc"
+
+static TokenType Lookup(const char* text) {
+	uint32_t length = strlen(text);
+	uint32_t slot = KEYWORD_HASH(length, (uint8_t) text[0], 
+			(uint8_t) text[length - 1]);
+
+	if (klen[slot] == length && memcmp(keywords[slot], text, length) == 0)
+		return kmap[slot];
+
+	return TT_IDENT;
+}
+
+int main() {
+	static const struct {
+		const char* text;
+		TokenType type;
+	} cases[] = {
+#define KEYWORD(spelling, type) { spelling, type },
+#include "keywords.def"
+#undef KEYWORD
+		{ "lets", TT_IDENT },
+		{ "fn", TT_IDENT },
+		{ "iff", TT_IDENT },
+		{ "x", TT_IDENT }
+	};
+
+	int failed = 0;
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		if (Lookup(cases[i].text) != cases[i].type) {
+			printf("keyword table: wrong token for %s\n", cases[i].text);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
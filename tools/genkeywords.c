@@ -0,0 +1,117 @@
+/* Generates the keyword tables of the lexer from include/keywords.def.
+ * 
+ * The tables are a perfect hash over (length, first character, last 
+ * character) of each keyword, so looking up an identifier costs one probe
+ * and one compare. We search for the smallest table and multipliers that 
+ * make the hash collision free, and fail the build if there are none */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct Keyword {
+	const char* spelling;
+	const char* type;
+} Keyword;
+
+static const Keyword keywords[] = {
+#define KEYWORD(spelling, type) { spelling, #type },
+#include "keywords.def"
+#undef KEYWORD
+};
+
+#define NKEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+#define MAX_MULTIPLIER 64
+#define MAX_TABLE_SIZE 4096
+
+static uint32_t Hash(const char* kw, uint32_t m1, uint32_t m2, uint32_t mask) {
+	uint32_t len = strlen(kw);
+	return (len * m1 + (uint8_t) kw[0] * m2 + (uint8_t) kw[len - 1]) & mask;
+}
+
+static int CollisionFree(uint32_t m1, uint32_t m2, uint32_t size) {
+	static unsigned char used[MAX_TABLE_SIZE];
+	memset(used, 0, size);
+
+	for (uint32_t i = 0; i < NKEYWORDS; i++) {
+		uint32_t slot = Hash(keywords[i].spelling, m1, m2, size - 1);
+		if (used[slot])
+			return 0;
+
+		used[slot] = 1;
+	}
+
+	return 1;
+}
+
+static void Emit(uint32_t m1, uint32_t m2, uint32_t size) {
+	const Keyword* table[MAX_TABLE_SIZE] = { NULL };
+	for (uint32_t i = 0; i < NKEYWORDS; i++)
+		table[Hash(keywords[i].spelling, m1, m2, size - 1)] = &keywords[i];
+
+	printf("/* Generated by tools/genkeywords.c from include/keywords.def, "
+		"do not edit */\n\n");
+	printf("#define KEYWORD_TABLE_SIZE %u\n", size);
+	printf("#define KEYWORD_HASH(len, first, last) \\\n"
+		"\t(((len) * %uu + (first) * %uu + (last)) & %uu)\n\n", m1, m2, size - 1);
+
+	printf("static const char* keywords[KEYWORD_TABLE_SIZE] = {\n");
+	for (uint32_t i = 0; i < size; i++) {
+		if (table[i])
+			printf("\t[%u] = \"%s\",\n", i, table[i]->spelling);
+	}
+	printf("};\n\n");
+
+	printf("static const uint32_t klen[KEYWORD_TABLE_SIZE] = {\n");
+	for (uint32_t i = 0; i < size; i++) {
+		if (table[i])
+			printf("\t[%u] = sizeof(\"%s\") - 1,\n", i, table[i]->spelling);
+	}
+	printf("};\n\n");
+
+	printf("static const TokenType kmap[KEYWORD_TABLE_SIZE] = {\n");
+	for (uint32_t i = 0; i < size; i++) {
+		if (table[i])
+			printf("\t[%u] = %s,\n", i, table[i]->type);
+	}
+	printf("};\n\n");
+
+	// The lengths above are computed by the compiler, these check that the
+	// hash we computed here agrees with them
+	for (uint32_t i = 0; i < NKEYWORDS; i++) {
+		printf("_Static_assert(KEYWORD_HASH(sizeof(\"%s\") - 1, '%c', '%c') "
+			"== %u, \"keyword table is stale for %s\");\n", 
+			keywords[i].spelling, keywords[i].spelling[0], 
+			keywords[i].spelling[strlen(keywords[i].spelling) - 1],
+			Hash(keywords[i].spelling, m1, m2, size - 1), 
+			keywords[i].spelling);
+	}
+}
+
+int main() {
+	for (uint32_t i = 0; i < NKEYWORDS; i++) {
+		if (!strlen(keywords[i].spelling)) {
+			fprintf(stderr, "genkeywords: empty keyword\n");
+			return 1;
+		}
+	}
+
+	uint32_t size = 8;
+	while (size < 2 * NKEYWORDS)
+		size *= 2;
+
+	for (; size <= MAX_TABLE_SIZE; size *= 2) {
+		for (uint32_t m1 = 1; m1 < MAX_MULTIPLIER; m1++) {
+			for (uint32_t m2 = 1; m2 < MAX_MULTIPLIER; m2++) {
+				if (CollisionFree(m1, m2, size)) {
+					Emit(m1, m2, size);
+					return 0;
+				}
+			}
+		}
+	}
+
+	fprintf(stderr, "genkeywords: no collision free hash over (length, first,"
+		" last) exists for these keywords\n");
+	return 1;
+}